@@ -0,0 +1,61 @@
+#include "allocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+std::atomic<uint64_t> gHeapAllocations{0};
+std::atomic<uint64_t> gMatAllocations{0};
+
+// Counts and forwards to OpenCV's own allocator. The buffers it creates
+// record the standard allocator as their owner, so they are freed by it
+// directly.
+class CountingMatAllocator : public cv::MatAllocator {
+ public:
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data,
+                         size_t* step, cv::AccessFlag flags,
+                         cv::UMatUsageFlags usageFlags) const override {
+    // A caller-provided buffer is only wrapped, not allocated.
+    if (!data) gMatAllocations.fetch_add(1, std::memory_order_relaxed);
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step,
+                                                flags, usageFlags);
+  }
+  bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags,
+                cv::UMatUsageFlags usageFlags) const override {
+    return cv::Mat::getStdAllocator()->allocate(data, accessFlags,
+                                                usageFlags);
+  }
+  void deallocate(cv::UMatData* data) const override {
+    cv::Mat::getStdAllocator()->deallocate(data);
+  }
+};
+
+}  // namespace
+
+// The array and nothrow forms of new call this one, so they are counted too.
+void* operator new(std::size_t size) {
+  gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* memory = std::malloc(size ? size : 1)) return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+void installAllocationCounter() {
+  static CountingMatAllocator allocator;
+  cv::Mat::setDefaultAllocator(&allocator);
+}
+
+AllocationCount allocationCount() {
+  AllocationCount count;
+  count.heap = gHeapAllocations.load(std::memory_order_relaxed);
+  count.mat_buffers = gMatAllocations.load(std::memory_order_relaxed);
+  return count;
+}
@@ -0,0 +1,20 @@
+#ifndef ALLOCATION_COUNTER
+#define ALLOCATION_COUNTER
+
+#include <cstdint>
+
+// Test hook counting heap allocations, so a benchmark can show that the
+// per-frame path stops allocating once it has warmed up. Linking
+// allocationCounter.cpp replaces the program's global operator new, which is
+// why only motion_bench links it, never motion_detect.
+struct AllocationCount {
+  uint64_t heap = 0;         // operator new calls (including std containers)
+  uint64_t mat_buffers = 0;  // cv::Mat data buffers (cv::fastMalloc)
+};
+
+// Starts counting cv::Mat buffers; operator new is counted from startup.
+void installAllocationCounter();
+
+AllocationCount allocationCount();
+
+#endif /* ALLOCATION_COUNTER */
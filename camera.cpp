@@ -0,0 +1,87 @@
+#include "camera.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+
+#include "defines.hpp"
+#include "utils.hpp"
+
+std::vector<std::unique_ptr<Camera>> gCameras;
+
+namespace {
+
+std::string recordingsDirFor(int id) {
+  if (id == 0) return RECORDINGS_DIR;
+  return RECORDINGS_DIR + "/cam" + std::to_string(id);
+}
+
+void pinToCore(std::thread& thread, int core) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  int err = pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+  if (err != 0) {
+    std::cerr << "[Camera] Warning: Could not pin thread to core " << core
+              << " (error " << err << ")." << std::endl;
+  }
+}
+
+}  // namespace
+
+Camera::Camera(int id, std::unique_ptr<FrameSource> source)
+    : id(id),
+      recordings_dir(recordingsDirFor(id)),
+      source(std::move(source)),
+      frames(FRAME_POOL_MAX_FRAMES),
+      bus(FRAME_BUS_CAPACITY),
+      index(recordings_dir + "/" + DETECTION_INDEX_FILE),
+      thumbnails(recordings_dir, THUMBNAIL_CACHE_BYTES),
+      recorder(RECORDER_QUEUE_CAPACITY, recordings_dir, index, thumbnails),
+      live(bus, LIVE_JPEG_QUALITY),
+      classifier(recordings_dir, CLASSIFIER_RESULTS_FILE, index),
+      exporter(this->source->frameSize(), FRAME_EXPORT_RING_FRAMES) {
+  // The source is open, so the frame size is known: allocate the image
+  // buffers now rather than on the first frames.
+  cv::Size size = this->source->frameSize();
+  frames.preallocate(FRAME_POOL_FRAMES, [size](CapturedFrame& frame) {
+    if (size.area() > 0) frame.image.create(size, CV_8UC3);
+  });
+}
+
+bool Camera::openStorage() {
+  for (const std::string& dir : {RECORDINGS_DIR, recordings_dir}) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      perror(("[Camera] Failed to create " + dir).c_str());
+      return false;
+    }
+  }
+  return index.open(recordings_dir);
+}
+
+void Camera::start(int core) {
+  threads_.emplace_back(captureLoop, std::ref(*this));
+  threads_.emplace_back(&VideoRecorder::run, &recorder);
+  threads_.emplace_back(motionDetectionLoop, std::ref(*this));
+  if (core >= 0) pinToCore(threads_.back(), core);
+  threads_.emplace_back(&LiveStreamHub::run, &live);
+  threads_.emplace_back(&ClipClassifier::run, &classifier);
+  threads_.emplace_back(&FrameExport::run, &exporter);
+}
+
+void Camera::join() {
+  for (auto& thread : threads_) thread.join();
+  threads_.clear();
+}
+
+Camera* findCamera(int id) {
+  for (const auto& camera : gCameras) {
+    if (camera->id == id) return camera.get();
+  }
+  return nullptr;
+}
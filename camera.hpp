@@ -0,0 +1,63 @@
+#ifndef CAMERA
+#define CAMERA
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clipClassifier.hpp"
+#include "detectionIndex.hpp"
+#include "frameBus.hpp"
+#include "frameExport.hpp"
+#include "frameSource.hpp"
+#include "liveStreamHub.hpp"
+#include "recyclingPool.hpp"
+#include "thumbnailCache.hpp"
+#include "videoRecorder.hpp"
+
+// One camera and its whole pipeline: capture publishes to its own frame bus,
+// which feeds its detector, recorder and live encoder, and its clips go to
+// its own recordings directory and detection index. Cameras share nothing on
+// the per-frame path, so adding one adds an independent set of threads.
+//
+// Camera 0 records into RECORDINGS_DIR itself, so single-camera setups keep
+// their existing recordings; camera N records into RECORDINGS_DIR/camN.
+struct Camera {
+  Camera(int id, std::unique_ptr<FrameSource> source);
+  Camera(const Camera&) = delete;
+  Camera& operator=(const Camera&) = delete;
+
+  // Creates the recordings directory and opens the index.
+  bool openStorage();
+
+  // Starts capture, detection, recording, live encoding, classification and
+  // frame export.
+  // The detector, the one CPU-bound stage, is pinned to `core` (-1: any).
+  void start(int core);
+  void join();
+
+  const int id;
+  const std::string recordings_dir;
+  std::unique_ptr<FrameSource> source;
+  RecyclingPool<CapturedFrame> frames;  // Filled by captureLoop only
+  FrameBus bus;
+  DetectionIndex index;
+  ThumbnailCache thumbnails;
+  VideoRecorder recorder;
+  LiveStreamHub live;
+  ClipClassifier classifier;
+  FrameExport exporter;  // Off unless main() opens it
+
+ private:
+  std::vector<std::thread> threads_;
+};
+
+// Every configured camera, indexed by id. Filled in by main() before any
+// thread starts and never changed afterwards.
+extern std::vector<std::unique_ptr<Camera>> gCameras;
+
+// nullptr if there is no camera `id`.
+Camera* findCamera(int id);
+
+#endif /* CAMERA */
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <thread>
+
+#include "camera.hpp"
+#include "defines.hpp"
+#include "utils.hpp"
+
+// --- Capture Loop ---
+// The only place that reads from a camera's source. Every frame is published
+// to the camera's bus, from where its detector, recorder and live streams
+// consume it.
+void captureLoop(Camera& camera) {
+  std::cout << "[Capture] Starting capture loop for camera " << camera.id
+            << "." << std::endl;
+
+  while (true) {
+    // A frame no consumer holds any more, so the source decodes into its
+    // buffer in place instead of allocating a new one. On failure it simply
+    // goes back to the pool.
+    std::shared_ptr<CapturedFrame> frame = camera.frames.acquire();
+    // Blocks until the source delivers (or paces) the next frame
+    auto readStart = std::chrono::steady_clock::now();
+    bool ok = camera.source->read(frame->image);
+    auto captureTime = std::chrono::steady_clock::now();
+    gMetrics.capture_seconds.observe(captureTime - readStart);
+
+    if (!ok || frame->image.empty()) {
+      gMetrics.capture_failures.add();
+      std::cerr << "[Capture] Warning: Empty frame captured on camera "
+                << camera.id << "." << std::endl;
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(100));  // Wait a bit before retrying
+      continue;
+    }
+
+    camera.bus.publish(std::move(frame), captureTime);
+    gMetrics.frames_captured.add();
+  }
+  std::cout << "[Capture] Exiting capture loop." << std::endl;
+}
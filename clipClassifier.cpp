@@ -0,0 +1,350 @@
+#include "clipClassifier.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "camera.hpp"
+#include "defines.hpp"
+#include "motionTimeline.hpp"
+#include "utils.hpp"
+
+namespace {
+
+// Held for a keyframe's inference and the budget sleep after it, so all
+// cameras' classifiers share one CPU budget.
+std::mutex gInferenceMutex;
+
+double threadCpuSeconds() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Class names may not contain our separators or break the JSON they end up
+// in. ImageNet-style "tench, Tinca tinca" lines keep the first name only.
+std::string cleanLabel(std::string label) {
+  label = label.substr(0, label.find(','));
+  label.erase(std::remove_if(label.begin(), label.end(),
+                             [](char c) {
+                               return c == ':' || c == '\t' || c == '"' ||
+                                      c == '\\' || c == '\r' ||
+                                      static_cast<unsigned char>(c) < 0x20;
+                             }),
+              label.end());
+  size_t begin = label.find_first_not_of(' ');
+  size_t end = label.find_last_not_of(' ');
+  return begin == std::string::npos ? ""
+                                    : label.substr(begin, end - begin + 1);
+}
+
+struct Keyframe {
+  int frame = 0;
+  cv::Rect bounds;  // Empty: use the whole frame
+};
+
+// The busiest frames of the clip, at least CLASSIFIER_KEYFRAME_SPACING apart
+// so one burst doesn't take every slot. Clips without a timeline get evenly
+// spaced frames.
+std::vector<Keyframe> pickKeyframes(const std::string& timelinePath,
+                                    int frameCount) {
+  std::vector<Keyframe> keyframes;
+  std::vector<TimelineSample> samples;
+  if (readTimeline(timelinePath, samples) && !samples.empty()) {
+    std::vector<int> order(samples.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return samples[a].motion > samples[b].motion;
+    });
+    for (int frame : order) {
+      const TimelineSample& sample = samples[frame];
+      if (sample.motion <= 0 ||
+          static_cast<int>(keyframes.size()) >= CLASSIFIER_KEYFRAMES) {
+        break;
+      }
+      bool tooClose = std::any_of(
+          keyframes.begin(), keyframes.end(), [&](const Keyframe& k) {
+            return std::abs(k.frame - frame) < CLASSIFIER_KEYFRAME_SPACING;
+          });
+      if (tooClose) continue;
+      keyframes.push_back(
+          {frame, cv::Rect(sample.x, sample.y, sample.width, sample.height)});
+    }
+  }
+  if (keyframes.empty() && frameCount > 0) {
+    for (int i = 1; i <= CLASSIFIER_KEYFRAMES; ++i) {
+      keyframes.push_back({frameCount * i / (CLASSIFIER_KEYFRAMES + 1), {}});
+    }
+  }
+  // Decoding in file order keeps the seeks forward.
+  std::sort(keyframes.begin(), keyframes.end(),
+            [](const Keyframe& a, const Keyframe& b) {
+              return a.frame < b.frame;
+            });
+  return keyframes;
+}
+
+// Grows `bounds` by CLASSIFIER_CROP_PADDING on every side (objects are
+// usually larger than the part that moved) and clips it to the frame.
+cv::Rect paddedCrop(const cv::Rect& bounds, cv::Size frameSize) {
+  cv::Rect frame(0, 0, frameSize.width, frameSize.height);
+  if (bounds.width <= 0 || bounds.height <= 0) return frame;
+  int padX = static_cast<int>(bounds.width * CLASSIFIER_CROP_PADDING);
+  int padY = static_cast<int>(bounds.height * CLASSIFIER_CROP_PADDING);
+  cv::Rect padded(bounds.x - padX, bounds.y - padY, bounds.width + 2 * padX,
+                  bounds.height + 2 * padY);
+  cv::Rect clipped = padded & frame;
+  return clipped.area() > 0 ? clipped : frame;
+}
+
+}  // namespace
+
+ClipClassifier::ClipClassifier(std::string recordingsDir,
+                               std::string resultsFile, DetectionIndex& index)
+    : recordingsDir_(std::move(recordingsDir)),
+      resultsPath_(recordingsDir_ + "/" + resultsFile),
+      index_(index) {}
+
+void ClipClassifier::setModel(std::string modelPath, std::string configPath,
+                              std::string labelsPath) {
+  modelPath_ = std::move(modelPath);
+  configPath_ = std::move(configPath);
+  labelsPath_ = std::move(labelsPath);
+}
+
+bool ClipClassifier::loadModel() {
+  if (modelPath_.empty() || access(modelPath_.c_str(), R_OK) != 0) {
+    std::cout << "[Classifier] No model at '" << modelPath_
+              << "', clips will not be classified." << std::endl;
+    return false;
+  }
+  try {
+    net_ = cv::dnn::readNet(modelPath_, configPath_);
+    net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+  } catch (const cv::Exception& e) {
+    std::cerr << "[Classifier] Error: Could not load " << modelPath_ << ": "
+              << e.what() << std::endl;
+    return false;
+  }
+  if (net_.empty()) return false;
+
+  std::ifstream labels(labelsPath_);
+  std::string line;
+  while (std::getline(labels, line)) classNames_.push_back(cleanLabel(line));
+  std::cout << "[Classifier] Loaded " << modelPath_ << " with "
+            << classNames_.size() << " labels." << std::endl;
+  return true;
+}
+
+void ClipClassifier::loadResults() {
+  std::ifstream in(resultsPath_);
+  std::string line;
+  size_t loaded = 0;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string position, filename, list;
+    if (!std::getline(fields, position, '\t') ||
+        !std::getline(fields, filename, '\t')) {
+      continue;  // Torn last line
+    }
+    std::getline(fields, list);
+    std::vector<ClipLabel> labels;
+    std::istringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+      size_t colon = entry.rfind(':');
+      if (colon == std::string::npos) continue;
+      labels.push_back(
+          {entry.substr(0, colon), std::strtof(entry.c_str() + colon + 1,
+                                               nullptr)});
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    labels_[filename] = std::move(labels);
+    cursor_ = std::max<uint64_t>(cursor_,
+                                 std::strtoull(position.c_str(), nullptr, 10) +
+                                     1);
+    loaded++;
+  }
+  if (loaded > 0) {
+    std::cout << "[Classifier] Resuming after " << loaded
+              << " classified clips, at index position " << cursor_ << "."
+              << std::endl;
+  }
+}
+
+std::vector<ClipLabel> ClipClassifier::labels(
+    const std::string& filename) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = labels_.find(filename);
+  return it == labels_.end() ? std::vector<ClipLabel>() : it->second;
+}
+
+void ClipClassifier::waitUntilIdle() {
+  auto anyRecording = [] {
+    for (const auto& camera : gCameras) {
+      if (camera->recorder.recording()) return true;
+    }
+    return false;
+  };
+  while (gLiveStreamClientCount.load(std::memory_order_relaxed) > 0 ||
+         anyRecording() || gGovernor.level() > 0) {
+    paused_.store(true, std::memory_order_relaxed);
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(CLASSIFIER_PAUSE_POLL_MS));
+  }
+  paused_.store(false, std::memory_order_relaxed);
+}
+
+bool ClipClassifier::classifyCrop(const cv::Mat& crop, ClipLabel& best) {
+  cv::Mat blob = cv::dnn::blobFromImage(
+      crop, CLASSIFIER_INPUT_SCALE,
+      cv::Size(CLASSIFIER_INPUT_SIZE, CLASSIFIER_INPUT_SIZE),
+      cv::Scalar(CLASSIFIER_INPUT_MEAN, CLASSIFIER_INPUT_MEAN,
+                 CLASSIFIER_INPUT_MEAN),
+      true, false);
+  net_.setInput(blob);
+  cv::Mat scores = net_.forward().reshape(1, 1);
+  if (scores.empty()) return false;
+  scores.convertTo(scores, CV_32F);
+  const float* score = scores.ptr<float>();
+  int count = static_cast<int>(scores.total());
+
+  int classId = static_cast<int>(std::max_element(score, score + count) -
+                                 score);
+  float confidence = score[classId];
+  // Models that end in logits rather than a softmax layer
+  if (*std::min_element(score, score + count) < 0 || confidence > 1) {
+    double sum = 0;
+    for (int i = 0; i < count; ++i) sum += std::exp(score[i] - score[classId]);
+    confidence = static_cast<float>(1.0 / sum);
+  }
+  best.label = classId < static_cast<int>(classNames_.size())
+                   ? classNames_[classId]
+                   : "class" + std::to_string(classId);
+  best.confidence = confidence;
+  return !best.label.empty();
+}
+
+std::vector<ClipLabel> ClipClassifier::classify(
+    const DetectionRecord& record) {
+  std::string name = record.name();
+  std::vector<Keyframe> keyframes = pickKeyframes(
+      recordingsDir_ + "/" + timelineNameFor(name), record.frame_count);
+
+  cv::VideoCapture clip(recordingsDir_ + "/" + name);
+  std::map<std::string, float> best;  // Highest confidence per label
+  cv::Mat frame;
+  for (const Keyframe& keyframe : keyframes) {
+    waitUntilIdle();
+    std::lock_guard<std::mutex> turn(gInferenceMutex);
+    double cpuStart = threadCpuSeconds();
+    // MJPEG frames are independent, so seeking decodes just this one.
+    clip.set(cv::CAP_PROP_POS_FRAMES, keyframe.frame);
+    ClipLabel label;
+    if (clip.read(frame) && !frame.empty() &&
+        classifyCrop(frame(paddedCrop(keyframe.bounds, frame.size())),
+                     label) &&
+        label.confidence >= CLASSIFIER_MIN_CONFIDENCE) {
+      float& confidence = best[label.label];
+      confidence = std::max(confidence, label.confidence);
+    }
+
+    // Idle for long enough that this thread stays within its share.
+    double cpu = threadCpuSeconds() - cpuStart;
+    std::this_thread::sleep_for(std::chrono::duration<double>(
+        cpu * (100.0 / CLASSIFIER_CPU_BUDGET_PERCENT - 1.0)));
+  }
+
+  std::vector<ClipLabel> labels;
+  for (const auto& entry : best) labels.push_back({entry.first, entry.second});
+  std::sort(labels.begin(), labels.end(),
+            [](const ClipLabel& a, const ClipLabel& b) {
+              return a.confidence > b.confidence;
+            });
+  if (labels.size() > CLASSIFIER_MAX_LABELS) {
+    labels.resize(CLASSIFIER_MAX_LABELS);
+  }
+  return labels;
+}
+
+void ClipClassifier::saveBatch(
+    const std::vector<uint64_t>& positions,
+    const std::vector<DetectionRecord>& records,
+    const std::vector<std::vector<ClipLabel>>& results) {
+  for (size_t i = 0; i < results.size(); ++i) {
+    std::fprintf(results_, "%llu\t%s\t",
+                 static_cast<unsigned long long>(positions[i]),
+                 records[i].name().c_str());
+    for (size_t j = 0; j < results[i].size(); ++j) {
+      std::fprintf(results_, "%s%s:%.3f", j ? "," : "",
+                   results[i][j].label.c_str(), results[i][j].confidence);
+    }
+    std::fputc('\n', results_);
+  }
+  // One sync per batch: after a crash at most the batch is redone.
+  if (std::fflush(results_) != 0 || fdatasync(fileno(results_)) != 0) {
+    perror("[Classifier] Failed to save results");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < results.size(); ++i) {
+      labels_[records[i].name()] = results[i];
+    }
+  }
+  classifiedClips_.fetch_add(results.size(), std::memory_order_relaxed);
+  generation_.fetch_add(1, std::memory_order_release);
+}
+
+void ClipClassifier::run() {
+  // Only ever use CPU time nothing else wants.
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)),
+              CLASSIFIER_NICE);
+  sched_param param{};
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+    std::cerr << "[Classifier] Warning: Could not switch to SCHED_IDLE."
+              << std::endl;
+  }
+
+  if (!loadModel()) return;
+  loadResults();
+  results_ = std::fopen(resultsPath_.c_str(), "a");
+  if (!results_) {
+    perror(("[Classifier] Failed to open " + resultsPath_).c_str());
+    return;
+  }
+  std::cout << "[Classifier] Starting classification loop." << std::endl;
+
+  while (true) {
+    DetectionIndex::Page page =
+        index_.since(cursor_, CLASSIFIER_BATCH_CLIPS);
+    if (page.records.empty()) {
+      cursor_ = static_cast<uint64_t>(page.next_cursor);
+      std::this_thread::sleep_for(
+          std::chrono::seconds(CLASSIFIER_IDLE_SECONDS));
+      continue;
+    }
+
+    std::vector<std::vector<ClipLabel>> results;
+    results.reserve(page.records.size());
+    for (const auto& record : page.records) {
+      results.push_back(classify(record));
+    }
+    saveBatch(page.positions, page.records, results);
+    cursor_ = static_cast<uint64_t>(page.next_cursor);
+  }
+  std::cout << "[Classifier] Exiting classification loop." << std::endl;
+}
@@ -0,0 +1,96 @@
+#ifndef CLIP_CLASSIFIER
+#define CLIP_CLASSIFIER
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "detectionIndex.hpp"
+
+struct ClipLabel {
+  std::string label;
+  float confidence = 0;
+};
+
+// Labels recorded clips with a CPU DNN classifier, long after the fact: the
+// Pi is too weak to do this in real time, so the worker only looks at a few
+// keyframes per clip (the busiest frames from the timeline sidecar), cropped
+// to where the motion was, and only while nothing more important needs the
+// CPU.
+//
+// Each camera has its own classifier, but only one of them runs inference at
+// a time. The worker thread runs at SCHED_IDLE with CLASSIFIER_NICE and sleeps
+// after each inference, still holding its turn, so the classifiers together
+// stay within CLASSIFIER_CPU_BUDGET_PERCENT. They pause while anyone watches
+// /live, while any camera is recording a clip and while the governor has
+// stepped quality down.
+//
+// Results are appended to a text file next to the clips, one line per clip
+// ("position<TAB>filename<TAB>label:confidence,..."), a batch at a time, so
+// after a restart the worker resumes after the last clip it saved.
+class ClipClassifier {
+ public:
+  // Classifies the clips listed in `index`, which live in `recordingsDir`.
+  ClipClassifier(std::string recordingsDir, std::string resultsFile,
+                 DetectionIndex& index);
+  ClipClassifier(const ClipClassifier&) = delete;
+  ClipClassifier& operator=(const ClipClassifier&) = delete;
+
+  // Must be called before run(). `configPath` may be empty for formats that
+  // need none (e.g. ONNX); `labelsPath` has one class name per line.
+  void setModel(std::string modelPath, std::string configPath,
+                std::string labelsPath);
+
+  // Worker thread entry point. Returns at once if the model can't be loaded.
+  void run();
+
+  // Labels of a clip, best first; empty if it was not classified (yet) or
+  // nothing was recognised.
+  std::vector<ClipLabel> labels(const std::string& filename) const;
+
+  // Bumped whenever results are added, for cache validation.
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+  uint64_t classifiedClips() const {
+    return classifiedClips_.load(std::memory_order_relaxed);
+  }
+  bool paused() const { return paused_.load(std::memory_order_relaxed); }
+
+ private:
+  bool loadModel();
+  void loadResults();
+  void waitUntilIdle();
+  std::vector<ClipLabel> classify(const DetectionRecord& record);
+  bool classifyCrop(const cv::Mat& crop, ClipLabel& best);
+  void saveBatch(const std::vector<uint64_t>& positions,
+                 const std::vector<DetectionRecord>& records,
+                 const std::vector<std::vector<ClipLabel>>& results);
+
+  const std::string recordingsDir_;
+  const std::string resultsPath_;
+  DetectionIndex& index_;
+  std::string modelPath_;
+  std::string configPath_;
+  std::string labelsPath_;
+
+  // Worker thread state
+  cv::dnn::Net net_;
+  std::vector<std::string> classNames_;
+  uint64_t cursor_ = 0;  // Next index position to classify
+  FILE* results_ = nullptr;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<ClipLabel>> labels_;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<uint64_t> classifiedClips_{0};
+  std::atomic<bool> paused_{false};
+};
+
+#endif /* CLIP_CLASSIFIER */
@@ -0,0 +1,51 @@
+#include "clipPolicy.hpp"
+
+namespace {
+
+ClipPolicy::Clock::duration seconds(double value) {
+  return std::chrono::duration_cast<ClipPolicy::Clock::duration>(
+      std::chrono::duration<double>(value));
+}
+
+}  // namespace
+
+ClipPolicy::ClipPolicy(double postMotionSeconds, double mergeGapSeconds,
+                       double maxLengthSeconds)
+    : postMotion_(seconds(postMotionSeconds)),
+      mergeGap_(seconds(mergeGapSeconds)),
+      maxLength_(seconds(maxLengthSeconds)) {}
+
+ClipPolicy::Action ClipPolicy::begin(Clock::time_point captureTime) {
+  state_ = State::Recording;
+  clipStart_ = captureTime;
+  lastMotion_ = captureTime;
+  return Action::Begin;
+}
+
+ClipPolicy::Action ClipPolicy::update(Clock::time_point captureTime,
+                                      bool motion) {
+  if (state_ == State::Idle) {
+    return motion ? begin(captureTime) : Action::Buffer;
+  }
+
+  bool full = captureTime - clipStart_ >= maxLength_;
+  if (motion) {
+    if (full) {
+      begin(captureTime);
+      return Action::Split;
+    }
+    bool resumed = state_ == State::Waiting;
+    state_ = State::Recording;
+    lastMotion_ = captureTime;
+    return resumed ? Action::Resume : Action::Write;
+  }
+
+  Clock::duration quiet = captureTime - lastMotion_;
+  if (!full && quiet <= postMotion_) return Action::Write;  // Tail
+  if (!full && quiet <= postMotion_ + mergeGap_) {
+    state_ = State::Waiting;
+    return Action::Buffer;
+  }
+  state_ = State::Idle;
+  return Action::End;
+}
@@ -0,0 +1,53 @@
+#ifndef CLIP_POLICY
+#define CLIP_POLICY
+
+#include <chrono>
+
+// Decides, frame by frame, what happens to the recording given whether the
+// frame showed motion. A clip opens on motion and stays open while motion
+// continues; it keeps recording for `postMotion` after the last motion (the
+// tail). When the tail runs out the writer is held open for `mergeGap`
+// longer without writing: frames go back to the pre-roll history, and if
+// motion returns in that window the history is flushed into the same clip
+// and recording carries on. With mergeGap <= PREROLL_SECONDS the merged clip
+// is continuous. A clip never grows past `maxLength`; if motion is still
+// going on then it is split into a new clip.
+//
+// Pure bookkeeping on capture timestamps, so the detector and motion_bench
+// drive the same rules.
+class ClipPolicy {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Action {
+    Buffer,  // No clip is being written; keep the frame as pre-roll
+    Begin,   // Open a clip with the pre-roll history, then write the frame
+    Write,   // Write the frame to the open clip
+    Resume,  // Motion within the merge gap: flush pre-roll, write the frame
+    End,     // Close the clip, keep the frame as pre-roll
+    Split,   // Maximum length reached: close the clip, begin a new one
+  };
+
+  ClipPolicy(double postMotionSeconds, double mergeGapSeconds,
+             double maxLengthSeconds);
+
+  // `motion` is false for frames that were not analysed.
+  Action update(Clock::time_point captureTime, bool motion);
+
+  // A clip is open, whether it is being written or waiting in the gap.
+  bool clipOpen() const { return state_ != State::Idle; }
+
+ private:
+  enum class State { Idle, Recording, Waiting };
+
+  Action begin(Clock::time_point captureTime);
+
+  const Clock::duration postMotion_;
+  const Clock::duration mergeGap_;
+  const Clock::duration maxLength_;
+  State state_ = State::Idle;
+  Clock::time_point clipStart_;
+  Clock::time_point lastMotion_;
+};
+
+#endif /* CLIP_POLICY */
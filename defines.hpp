@@ -1,6 +1,7 @@
 #ifndef DEFINES
 #define DEFINES
 
+#include <cstdint>
 #include <string>
 
 // --- Configuration ---
@@ -9,18 +10,137 @@ const double CAP_WIDTH = 1280;  // Frame width for processing
 const double CAP_HEIGHT = 720;  // Frame height for processing
 const double CAP_FPS = 30.0;    // Desired camera FPS
 const int HTTP_PORT = 8080;
+const size_t HTTP_WORKER_THREADS = 2;  // Event loop threads serving all clients
+const int HTTP_MAX_CONNECTIONS =
+    64;  // Open connections across all workers; extra clients get a 503
+const int HTTP_IDLE_TIMEOUT_SECONDS =
+    30;  // Close connections that make no read/write progress for this long
+const size_t HTTP_MAX_REQUEST_BYTES = 8192;  // Limit for the request header
+const int LIVE_JPEG_QUALITY = 90;  // JPEG quality of the /live MJPEG stream
+const size_t LIVE_BACKLOG_FRAMES =
+    2;  // A /live viewer with more frames than this unsent drops a tier
+const int LIVE_STEP_UP_FRAMES =
+    90;  // Frames sent with an empty socket queue before trying a better tier
+const int SSE_KEEPALIVE_SECONDS =
+    15;  // Comment sent on a quiet /events stream after this long
 const std::string RECORDINGS_DIR = "recordings";  // Directory to save videos
+const size_t FRAME_BUS_CAPACITY =
+    8;  // Frames kept in the capture ring; slower consumers skip ahead
+const bool PIPELINE_PIN_DETECTORS =
+    true;  // Pin camera N's motion detector to core N % cores
 
 // Motion detection parameters
+const int ANALYSIS_SCALE =
+    2;  // Motion is analysed at 1/ANALYSIS_SCALE of the frame width and height
 const int GAUSSIAN_BLUR_SIZE =
     15;  // Kernel size for Gaussian blur (odd number)
 const double THRESHOLD_VALUE = 25;  // Threshold for detecting changes
-const int MIN_NON_ZERO_COUNT =
-    1000;  // Minimum non-zero pixels to trigger motion (adjust based on
-           // resolution and sensitivity)
-const int VIDEO_RECORD_DURATION_SECONDS =
-    5;  // Duration of recorded video clips
-const int MAX_RECENT_DETECTIONS =
-    20;  // Max number of video clips to keep track of
+// The frame is split into TILE_GRID_COLS x TILE_GRID_ROWS tiles. TILE_MASK has
+// one character per tile, row by row: '.' ignores the tile, a digit d makes it
+// active once d * TILE_PIXELS_PER_LEVEL pixels changed in it. Empty means
+// TILE_DEFAULT_LEVEL everywhere. Motion triggers when MIN_ACTIVE_TILES tiles
+// are active. Example ignoring the top-right corner of a 4x3 grid:
+// "22.." "2222" "2222"
+const int TILE_GRID_COLS = 8;
+const int TILE_GRID_ROWS = 6;
+const std::string TILE_MASK = "";
+const int TILE_PIXELS_PER_LEVEL =
+    100;  // Changed pixels per sensitivity level (full-resolution units)
+const int TILE_DEFAULT_LEVEL = 3;
+const int MIN_ACTIVE_TILES = 1;  // Active tiles needed to trigger recording
+// A clip runs from the first motion until RECORDING_POST_MOTION_SECONDS
+// after the last. Motion returning within RECORDING_MERGE_GAP_SECONDS after
+// that continues the same clip (keep it <= PREROLL_SECONDS so the merged clip
+// has no cut); clips longer than RECORDING_MAX_SECONDS are split.
+const double RECORDING_POST_MOTION_SECONDS = 5.0;
+const double RECORDING_MERGE_GAP_SECONDS = 2.0;
+const double RECORDING_MAX_SECONDS = 300.0;
+const double PREROLL_SECONDS =
+    2.0;  // Seconds of history prepended to each clip (0 disables pre-roll)
+const size_t PREROLL_MEMORY_BUDGET_BYTES =
+    8 * 1024 * 1024;  // Arena holding the compressed pre-roll frames
+const int PREROLL_JPEG_QUALITY = 80;  // Quality of the buffered pre-roll frames
+const size_t RECORDER_QUEUE_CAPACITY =
+    24;  // Frames waiting for the clip writer before new ones are dropped
+// Captured frames are recycled once every consumer is done with them. The
+// pool starts with what idle operation holds (the bus ring, the detector's
+// current and peak frame, the live encoder's) and may grow to cover a full
+// recorder queue and the frames held by the frame export.
+const size_t FRAME_POOL_FRAMES = FRAME_BUS_CAPACITY + 3;
+const size_t FRAME_POOL_MAX_FRAMES =
+    FRAME_BUS_CAPACITY + RECORDER_QUEUE_CAPACITY + 6;
+const std::string DETECTION_INDEX_FILE =
+    "detections.idx";  // Persistent event index inside RECORDINGS_DIR
+const int THUMBNAIL_WIDTH = 160;  // Poster frame width, height keeps aspect
+const int THUMBNAIL_JPEG_QUALITY = 70;
+const size_t THUMBNAIL_CACHE_BYTES =
+    2 * 1024 * 1024;  // Thumbnails kept in memory for /thumbs/
+const size_t DETECTIONS_PAGE_SIZE = 20;  // Default /detections page size
+const size_t DETECTIONS_MAX_PAGE_SIZE = 500;  // Largest ?limit= honoured
+
+// Retention: the oldest clips are deleted while recordings use more than
+// RETENTION_MAX_BYTES or the disk has less than RETENTION_MIN_FREE_BYTES free
+// (0 disables either limit; --retention-quota-mb / --retention-min-free-mb).
+const uint64_t RETENTION_MAX_BYTES = 2ULL * 1024 * 1024 * 1024;
+const uint64_t RETENTION_MIN_FREE_BYTES = 256ULL * 1024 * 1024;
+const int RETENTION_INTERVAL_SECONDS = 60;  // Periodic check between clips
+const int RETENTION_BATCH_CLIPS = 4;        // Deletions per batch
+const int RETENTION_BATCH_PAUSE_MS = 200;   // Pause between batches
+
+// Recording storage: clips are written to a staging file in RAM and copied to
+// the card by one I/O thread in large aligned blocks (see StorageWriter).
+const std::string STORAGE_STAGING_DIR =
+    "/dev/shm/motion_staging";  // --staging-dir; "" writes clips in place
+const size_t STORAGE_BLOCK_BYTES = 1024 * 1024;  // Unit of writes to the card
+const int STORAGE_FSYNC_SECONDS =
+    0;  // --fsync: 0 syncs each finished clip, N syncs all clips every N s
+const double STORAGE_PREALLOCATE_SECONDS =
+    30;  // Clip files are preallocated this much video at a time
+const int STORAGE_POLL_MS = 250;  // How often staged data is picked up
+
+// Frame export to local consumer processes (see FrameExport). Camera N
+// listens on FRAME_EXPORT_SOCKET_PREFIX + N + ".sock".
+const std::string FRAME_EXPORT_SOCKET_PREFIX =
+    "/tmp/motion_export_cam";  // --export-socket-prefix; "" disables export
+const size_t FRAME_EXPORT_RING_FRAMES =
+    6;  // Shared ring size; a consumer this far behind starts missing frames
+
+// Offline classification of recorded clips (--classifier-model etc.). Input
+// preprocessing matches MobileNet-style classifiers: pixels are mapped with
+// (value - CLASSIFIER_INPUT_MEAN) * CLASSIFIER_INPUT_SCALE, RGB order.
+const std::string CLASSIFIER_MODEL_PATH = "models/classifier.onnx";
+const std::string CLASSIFIER_CONFIG_PATH = "";  // Only some formats need one
+const std::string CLASSIFIER_LABELS_PATH = "models/classifier.labels";
+const std::string CLASSIFIER_RESULTS_FILE =
+    "classifications.tsv";  // Inside RECORDINGS_DIR, one line per clip
+const int CLASSIFIER_INPUT_SIZE = 224;
+const double CLASSIFIER_INPUT_SCALE = 1.0 / 127.5;
+const double CLASSIFIER_INPUT_MEAN = 127.5;
+const int CLASSIFIER_KEYFRAMES = 3;  // Frames classified per clip
+const int CLASSIFIER_KEYFRAME_SPACING = 15;  // Minimum frames between them
+const double CLASSIFIER_CROP_PADDING =
+    0.25;  // Motion bounds are grown by this fraction on each side
+const float CLASSIFIER_MIN_CONFIDENCE = 0.4f;  // Lower results are dropped
+const size_t CLASSIFIER_MAX_LABELS = 3;  // Labels kept per clip
+const int CLASSIFIER_NICE = 19;
+const int CLASSIFIER_CPU_BUDGET_PERCENT = 25;  // Of one core, while running
+const int CLASSIFIER_BATCH_CLIPS = 8;  // Clips per saved batch
+const int CLASSIFIER_PAUSE_POLL_MS = 1000;  // Recheck interval while paused
+const int CLASSIFIER_IDLE_SECONDS = 30;  // Poll for new clips when caught up
+
+// Adaptive governor: steps analysis rate, analysis resolution and live JPEG
+// quality down under heat, CPU load or pipeline backlog, and back up once the
+// device has been calm for a while. Motion always restores full quality.
+const std::string GOVERNOR_TEMP_PATH =
+    "/sys/class/thermal/thermal_zone0/temp";  // Millidegrees C; --thermal-path
+const double GOVERNOR_TEMP_HIGH_C = 70.0;  // Step down at or above this
+const double GOVERNOR_TEMP_LOW_C = 60.0;   // Only step up below this
+const double GOVERNOR_CPU_HIGH_PERCENT = 85.0;
+const double GOVERNOR_CPU_LOW_PERCENT = 60.0;
+const int GOVERNOR_INTERVAL_MS = 2000;  // Sampling period
+const int GOVERNOR_RECOVER_SAMPLES =
+    3;  // Consecutive calm samples needed before stepping back up
+const int GOVERNOR_MOTION_HOLD_SECONDS =
+    10;  // Full quality is held this long after the last motion
 
 #endif /* DEFINES */
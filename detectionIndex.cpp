@@ -0,0 +1,389 @@
+#include "detectionIndex.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+struct DetectionIndex::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'M', 'D', 'I', 'N', 'D', 'E', 'X', '\0'};
+// Version 2 added DetectionRecord::size_bytes and shortened the filename to
+// keep records at 80 bytes; version 1 indexes are migrated on open().
+const uint32_t INDEX_VERSION = 2;
+
+struct DetectionRecordV1 {
+  int64_t start_ms;
+  uint32_t duration_ms;
+  uint32_t frame_count;
+  uint32_t motion_score;
+  uint32_t flags;
+  char filename[56];
+};
+static_assert(sizeof(DetectionRecordV1) == sizeof(DetectionRecord),
+              "v1 and v2 records differ in layout, not size");
+// Address space reserved up front; ~800k records before the first remap.
+const size_t INITIAL_RESERVE_BYTES = 64 * 1024 * 1024;
+
+}  // namespace
+
+DetectionIndex::DetectionIndex(std::string path) : path_(std::move(path)) {}
+
+DetectionIndex::~DetectionIndex() {
+  if (map_) munmap(map_, mapBytes_);
+  if (fd_ >= 0) close(fd_);
+}
+
+const DetectionRecord* DetectionIndex::records() const {
+  return reinterpret_cast<const DetectionRecord*>(
+      static_cast<const char*>(map_) + sizeof(Header));
+}
+
+bool DetectionIndex::mapFile(size_t reserveBytes) {
+  void* map = mmap(nullptr, reserveBytes, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    perror("[DetectionIndex] mmap failed");
+    return false;
+  }
+  if (map_) munmap(map_, mapBytes_);
+  map_ = map;
+  mapBytes_ = reserveBytes;
+  return true;
+}
+
+bool DetectionIndex::open(const std::string& recordingsDir) {
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat st {};
+  if (fd_ < 0 || fstat(fd_, &st) < 0) {
+    perror("[DetectionIndex] Failed to open index");
+    return false;
+  }
+
+  bool fresh = st.st_size == 0;
+  if (fresh) {
+    Header header{};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.record_size = sizeof(DetectionRecord);
+    if (pwrite(fd_, &header, sizeof(header), 0) !=
+        static_cast<ssize_t>(sizeof(header))) {
+      perror("[DetectionIndex] Failed to write index header");
+      return false;
+    }
+    st.st_size = sizeof(header);
+  } else {
+    Header header{};
+    bool readable =
+        pread(fd_, &header, sizeof(header), 0) ==
+            static_cast<ssize_t>(sizeof(header)) &&
+        std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0;
+    if (readable && header.version == 1 &&
+        header.record_size == sizeof(DetectionRecordV1)) {
+      if (!migrateV1(recordingsDir) || fstat(fd_, &st) < 0) return false;
+    } else if (!readable || header.version != INDEX_VERSION ||
+               header.record_size != sizeof(DetectionRecord)) {
+      std::cerr << "[DetectionIndex] Error: " << path_
+                << " is not a compatible index; leaving it untouched."
+                << std::endl;
+      return false;
+    }
+  }
+
+  size_t body = static_cast<size_t>(st.st_size) - sizeof(Header);
+  count_ = body / sizeof(DetectionRecord);
+  if (body % sizeof(DetectionRecord) != 0) {
+    std::cerr << "[DetectionIndex] Dropping torn record at end of " << path_
+              << std::endl;
+    if (ftruncate(fd_, sizeof(Header) + count_ * sizeof(DetectionRecord)) <
+        0) {
+      perror("[DetectionIndex] ftruncate failed");
+    }
+  }
+
+  size_t needed = sizeof(Header) + count_ * sizeof(DetectionRecord);
+  if (!mapFile(std::max(INITIAL_RESERVE_BYTES, needed * 2))) return false;
+
+  if (fresh) importExisting(recordingsDir);
+  std::cout << "[DetectionIndex] " << count_ << " detections in " << path_
+            << std::endl;
+  return true;
+}
+
+// Rewrites a version 1 index next to the old one and renames it into place,
+// so a crash midway leaves one or the other. Clip sizes come from the files
+// on disk. Names too long for the new record were unreachable over HTTP
+// anyway (see importExisting()), so those records are dropped.
+bool DetectionIndex::migrateV1(const std::string& recordingsDir) {
+  struct stat st {};
+  if (fstat(fd_, &st) < 0) {
+    perror("[DetectionIndex] fstat failed");
+    return false;
+  }
+  size_t count = (static_cast<size_t>(st.st_size) - sizeof(Header)) /
+                 sizeof(DetectionRecordV1);
+  std::vector<DetectionRecordV1> old(count);
+  ssize_t bytes = static_cast<ssize_t>(count * sizeof(DetectionRecordV1));
+  if (pread(fd_, old.data(), bytes, sizeof(Header)) != bytes) {
+    perror("[DetectionIndex] Failed to read version 1 index");
+    return false;
+  }
+
+  Header header{};
+  std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = INDEX_VERSION;
+  header.record_size = sizeof(DetectionRecord);
+  std::vector<DetectionRecord> records;
+  size_t dropped = 0;
+  for (const DetectionRecordV1& v1 : old) {
+    size_t length = strnlen(v1.filename, sizeof(v1.filename));
+    if (length >= sizeof(DetectionRecord::filename)) {
+      dropped++;
+      continue;
+    }
+    DetectionRecord record;
+    record.start_ms = v1.start_ms;
+    record.duration_ms = v1.duration_ms;
+    record.frame_count = v1.frame_count;
+    record.motion_score = v1.motion_score;
+    record.flags = v1.flags & DetectionRecord::DELETED;
+    std::memcpy(record.filename, v1.filename, length);
+    struct stat clip {};
+    if (!(record.flags & DetectionRecord::DELETED) &&
+        stat((recordingsDir + "/" + record.name()).c_str(), &clip) == 0) {
+      record.size_bytes = static_cast<uint64_t>(clip.st_size);
+    }
+    records.push_back(record);
+  }
+
+  std::string tmpPath = path_ + ".v2";
+  int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+  ssize_t recordBytes =
+      static_cast<ssize_t>(records.size() * sizeof(DetectionRecord));
+  bool ok = fd >= 0 &&
+            pwrite(fd, &header, sizeof(header), 0) ==
+                static_cast<ssize_t>(sizeof(header)) &&
+            pwrite(fd, records.data(), recordBytes, sizeof(header)) ==
+                recordBytes &&
+            fdatasync(fd) == 0 && rename(tmpPath.c_str(), path_.c_str()) == 0;
+  if (!ok) {
+    perror(("[DetectionIndex] Failed to migrate " + path_).c_str());
+    if (fd >= 0) close(fd);
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  close(fd_);
+  fd_ = fd;
+  std::cout << "[DetectionIndex] Migrated " << records.size()
+            << " detections in " << path_ << " to version " << INDEX_VERSION;
+  if (dropped > 0) std::cout << " (" << dropped << " with long names dropped)";
+  std::cout << "." << std::endl;
+  return true;
+}
+
+void DetectionIndex::importExisting(const std::string& recordingsDir) {
+  DIR* dir = opendir(recordingsDir.c_str());
+  if (!dir) return;
+
+  std::vector<DetectionRecord> found;
+  while (dirent* entry = readdir(dir)) {
+    std::tm tm{};
+    const char* end = strptime(entry->d_name, "motion_%Y%m%d_%H%M%S", &tm);
+    if (!end || std::strcmp(end, ".avi") != 0 ||
+        std::strlen(entry->d_name) >= sizeof(DetectionRecord::filename)) {
+      continue;
+    }
+    tm.tm_isdst = -1;  // Names are in local time
+    DetectionRecord record;
+    record.start_ms = static_cast<int64_t>(mktime(&tm)) * 1000;
+    struct stat st {};
+    if (stat((recordingsDir + "/" + entry->d_name).c_str(), &st) == 0) {
+      record.size_bytes = static_cast<uint64_t>(st.st_size);
+    }
+    std::strncpy(record.filename, entry->d_name, sizeof(record.filename) - 1);
+    found.push_back(record);
+  }
+  closedir(dir);
+
+  std::sort(found.begin(), found.end(),
+            [](const DetectionRecord& a, const DetectionRecord& b) {
+              return a.start_ms < b.start_ms;
+            });
+  for (const auto& record : found) {
+    if (!append(record)) break;
+  }
+  if (!found.empty()) {
+    std::cout << "[DetectionIndex] Imported " << found.size()
+              << " existing clips from " << recordingsDir << std::endl;
+  }
+}
+
+void DetectionIndex::addListener(int eventFd) {
+  std::lock_guard<std::mutex> lock(listenersMutex_);
+  listeners_.push_back(eventFd);
+}
+
+void DetectionIndex::changed() {
+  generation_.fetch_add(1, std::memory_order_release);
+  uint64_t one = 1;
+  std::lock_guard<std::mutex> lock(listenersMutex_);
+  for (int eventFd : listeners_) {
+    if (write(eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      perror("[DetectionIndex] eventfd write failed");
+    }
+  }
+}
+
+bool DetectionIndex::append(DetectionRecord record) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!map_) return false;
+  if (count_ > 0) {
+    record.start_ms = std::max(record.start_ms, records()[count_ - 1].start_ms);
+  }
+
+  off_t offset = sizeof(Header) + count_ * sizeof(DetectionRecord);
+  if (pwrite(fd_, &record, sizeof(record), offset) !=
+      static_cast<ssize_t>(sizeof(record))) {
+    perror("[DetectionIndex] Append failed");
+    // Leave no partial record behind for the next append to land after.
+    if (ftruncate(fd_, offset) < 0) perror("[DetectionIndex] ftruncate");
+    return false;
+  }
+
+  size_t needed = offset + sizeof(record);
+  if (needed > mapBytes_ && !mapFile(mapBytes_ * 2)) return false;
+  if (namesBuilt_) names_[record.name()] = count_;
+  if (liveBytesKnown_) liveBytes_ += record.size_bytes;
+  count_++;
+  lock.unlock();
+  // Outside the lock: a slow card must not hold up queries from the HTTP
+  // workers, which would stall every connection on them.
+  if (fdatasync(fd_) != 0) perror("[DetectionIndex] fdatasync failed");
+  changed();
+  return true;
+}
+
+DetectionIndex::Page DetectionIndex::query(const Query& query) const {
+  Page page;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!map_) return page;
+
+  const DetectionRecord* begin = records();
+  const DetectionRecord* end = begin + count_;
+  uint64_t lo = std::partition_point(begin, end,
+                                     [&](const DetectionRecord& r) {
+                                       return r.start_ms < query.from_ms;
+                                     }) -
+                begin;
+  uint64_t hi = std::partition_point(begin, end,
+                                     [&](const DetectionRecord& r) {
+                                       return r.start_ms <= query.to_ms;
+                                     }) -
+                begin;
+  hi = std::min(hi, query.cursor);
+
+  page.records.reserve(std::min<uint64_t>(query.limit, hi > lo ? hi - lo : 0));
+  uint64_t position = hi;
+  while (position > lo && page.records.size() < query.limit) {
+    --position;
+    if (begin[position].flags & DetectionRecord::DELETED) continue;
+    page.records.push_back(begin[position]);
+    page.positions.push_back(position);
+  }
+  if (position > lo) page.next_cursor = static_cast<int64_t>(position);
+  return page;
+}
+
+DetectionIndex::Page DetectionIndex::since(uint64_t position,
+                                           size_t limit) const {
+  Page page;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (; position < count_ && page.records.size() < limit; ++position) {
+    if (records()[position].flags & DetectionRecord::DELETED) continue;
+    page.records.push_back(records()[position]);
+    page.positions.push_back(position);
+  }
+  page.next_cursor = static_cast<int64_t>(position);
+  return page;
+}
+
+bool DetectionIndex::contains(const std::string& filename) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!map_) return false;
+  if (!namesBuilt_) {
+    names_.reserve(count_);
+    for (uint64_t i = 0; i < count_; ++i) names_[records()[i].name()] = i;
+    namesBuilt_ = true;
+  }
+  auto it = names_.find(filename);
+  return it != names_.end() &&
+         !(records()[it->second].flags & DetectionRecord::DELETED);
+}
+
+bool DetectionIndex::oldestLive(uint64_t& position,
+                                DetectionRecord& record) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (; position < count_; ++position) {
+    if (!(records()[position].flags & DetectionRecord::DELETED)) {
+      record = records()[position];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DetectionIndex::markDeleted(uint64_t position) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (position >= count_) return false;
+  const DetectionRecord& current = records()[position];
+  if (current.flags & DetectionRecord::DELETED) return true;
+
+  uint32_t flags = current.flags | DetectionRecord::DELETED;
+  off_t offset = sizeof(Header) + position * sizeof(DetectionRecord) +
+                 offsetof(DetectionRecord, flags);
+  if (pwrite(fd_, &flags, sizeof(flags), offset) !=
+      static_cast<ssize_t>(sizeof(flags))) {
+    perror("[DetectionIndex] Failed to mark record deleted");
+    return false;
+  }
+  // Not synced: after a crash the clip just reappears as a dangling entry,
+  // which /videos/ answers with a 404 and retention deletes again.
+  if (liveBytesKnown_) liveBytes_ -= current.size_bytes;
+  lock.unlock();
+  changed();
+  return true;
+}
+
+uint64_t DetectionIndex::liveBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!map_) return 0;
+  if (!liveBytesKnown_) {
+    for (uint64_t i = 0; i < count_; ++i) {
+      if (!(records()[i].flags & DetectionRecord::DELETED)) {
+        liveBytes_ += records()[i].size_bytes;
+      }
+    }
+    liveBytesKnown_ = true;
+  }
+  return liveBytes_;
+}
+
+size_t DetectionIndex::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return count_;
+}
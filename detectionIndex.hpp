@@ -0,0 +1,129 @@
+#ifndef DETECTION_INDEX
+#define DETECTION_INDEX
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One recorded event, stored verbatim in the index file. Fixed size and
+// trivially copyable so the file can be used in place through mmap.
+struct DetectionRecord {
+  int64_t start_ms = 0;  // Unix time of the first frame; non-decreasing
+  uint64_t size_bytes = 0;  // Clip and sidecar file sizes when finished
+  uint32_t duration_ms = 0;
+  uint32_t frame_count = 0;
+  uint32_t motion_score = 0;  // Peak changed pixels in any analysed frame
+  uint32_t flags = 0;
+  char filename[48] = {};  // Base name inside RECORDINGS_DIR, NUL-padded
+
+  static constexpr uint32_t DELETED = 1;  // Clip removed from disk
+  static constexpr uint32_t HAS_THUMBNAIL = 2;  // ThumbnailCache has one
+  static constexpr uint32_t HAS_TIMELINE = 4;   // Timeline sidecar written
+
+  std::string name() const {
+    return std::string(filename, strnlen(filename, sizeof(filename)));
+  }
+};
+
+// Persistent, append-only list of detections. The file is a small header
+// followed by DetectionRecords in the order they were recorded, which is also
+// start time order, so the mapped file itself is the sorted structure:
+// time-range queries are two binary searches and reopening after a reboot
+// costs one mmap() no matter how many events there are.
+//
+// The mapping reserves more address space than the file needs; appends are
+// written with pwrite() and become visible through the shared mapping, so it
+// is only replaced when the reservation runs out. A torn record at the end
+// (power loss mid-append) is truncated away on open().
+//
+// All methods are thread-safe. The lock is held only for the binary searches
+// and copying out at most one page of results; append() syncs after
+// releasing it.
+class DetectionIndex {
+ public:
+  explicit DetectionIndex(std::string path);
+  ~DetectionIndex();
+  DetectionIndex(const DetectionIndex&) = delete;
+  DetectionIndex& operator=(const DetectionIndex&) = delete;
+
+  // Maps the index, creating it if missing. A new index is seeded once from
+  // the clips already in `recordingsDir`, so upgrading doesn't lose them.
+  bool open(const std::string& recordingsDir);
+
+  // Appends and fdatasync()s one record. `record.start_ms` is raised to the
+  // previous record's if the wall clock stepped backwards.
+  bool append(DetectionRecord record);
+
+  struct Query {
+    int64_t from_ms = std::numeric_limits<int64_t>::min();  // Inclusive
+    int64_t to_ms = std::numeric_limits<int64_t>::max();    // Inclusive
+    size_t limit = 20;
+    // Position to continue before, from a previous result's next_cursor.
+    uint64_t cursor = std::numeric_limits<uint64_t>::max();
+  };
+  struct Page {
+    std::vector<DetectionRecord> records;  // Newest first
+    std::vector<uint64_t> positions;       // Index position of each record
+    int64_t next_cursor = -1;              // -1 when nothing older matches
+  };
+  Page query(const Query& query) const;
+
+  // Live records at `position` or later, oldest first, at most `limit`.
+  // next_cursor is where the next call should continue (never -1).
+  Page since(uint64_t position, size_t limit) const;
+
+  // Bumped by every append() and markDeleted(), for cache validation.
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  // Registers an eventfd that is written to after every change.
+  void addListener(int eventFd);
+
+  // True if `filename` is a live (not deleted) clip in the index. The name
+  // lookup table is built on first use rather than at startup.
+  bool contains(const std::string& filename) const;
+
+  // Retention support. oldestLive() finds the first record at or after
+  // `position` that is not deleted and advances `position` to it.
+  // markDeleted() sets the DELETED flag in place (the only write that is not
+  // an append). liveBytes() totals size_bytes over live records; the sum is
+  // taken on first use and then kept up to date.
+  bool oldestLive(uint64_t& position, DetectionRecord& record) const;
+  bool markDeleted(uint64_t position);
+  uint64_t liveBytes() const;
+
+  size_t size() const;
+
+ private:
+  struct Header;
+
+  const DetectionRecord* records() const;
+  bool mapFile(size_t reserveBytes);
+  bool migrateV1(const std::string& recordingsDir);
+  void importExisting(const std::string& recordingsDir);
+  void changed();
+
+  std::string path_;
+  int fd_ = -1;
+  void* map_ = nullptr;
+  size_t mapBytes_ = 0;
+  uint64_t count_ = 0;
+
+  mutable std::mutex mutex_;
+  mutable bool namesBuilt_ = false;
+  mutable std::unordered_map<std::string, uint64_t> names_;
+  mutable bool liveBytesKnown_ = false;
+  mutable uint64_t liveBytes_ = 0;
+  std::atomic<uint64_t> generation_{0};
+
+  std::mutex listenersMutex_;
+  std::vector<int> listeners_;
+};
+
+#endif /* DETECTION_INDEX */
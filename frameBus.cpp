@@ -0,0 +1,64 @@
+#include "frameBus.hpp"
+
+FrameBus::FrameBus(size_t capacity) : slots_(capacity) {}
+
+void FrameBus::publish(std::shared_ptr<CapturedFrame> frame,
+                       std::chrono::steady_clock::time_point captureTime) {
+  frame->sequence = head_.load(std::memory_order_relaxed) + 1;
+  frame->capture_time = captureTime;
+
+  uint64_t sequence = frame->sequence;
+  std::atomic_store(&slots_[sequence % slots_.size()],
+                    FramePtr(std::move(frame)));
+  head_.store(sequence, std::memory_order_release);
+
+  // Taking the wait mutex (uncontended unless a consumer is about to sleep)
+  // closes the window between a consumer checking head() and parking.
+  { std::lock_guard<std::mutex> lock(waitMutex_); }
+  frameAvailable_.notify_all();
+}
+
+FramePtr FrameBus::slotFor(uint64_t sequence) const {
+  FramePtr frame = std::atomic_load(&slots_[sequence % slots_.size()]);
+  if (frame && frame->sequence == sequence) return frame;
+  return nullptr;  // Not published yet, or already overwritten
+}
+
+bool FrameBus::waitForNewerThan(uint64_t cursor,
+                                std::chrono::milliseconds timeout) {
+  if (head() > cursor) return true;
+  std::unique_lock<std::mutex> lock(waitMutex_);
+  return frameAvailable_.wait_for(lock, timeout,
+                                  [&] { return head() > cursor; });
+}
+
+FramePtr FrameBus::waitNext(uint64_t& cursor,
+                            std::chrono::milliseconds timeout) {
+  if (!waitForNewerThan(cursor, timeout)) return nullptr;
+
+  uint64_t newest = head();
+  uint64_t wanted = cursor + 1;
+  if (newest - wanted >= slots_.size()) {
+    wanted = newest - slots_.size() + 1;  // Fell behind, skip lost frames
+  }
+  // The producer may lap us between reading head() and reading the slot, in
+  // which case the slot holds a newer frame; keep moving forward.
+  for (; wanted <= newest; ++wanted) {
+    FramePtr frame = slotFor(wanted);
+    if (frame) {
+      cursor = wanted;
+      return frame;
+    }
+  }
+  return nullptr;
+}
+
+FramePtr FrameBus::waitLatest(uint64_t& cursor,
+                              std::chrono::milliseconds timeout) {
+  if (!waitForNewerThan(cursor, timeout)) return nullptr;
+
+  FramePtr frame;
+  while (!frame) frame = slotFor(head());
+  cursor = frame->sequence;
+  return frame;
+}
@@ -0,0 +1,63 @@
+#ifndef FRAME_BUS
+#define FRAME_BUS
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// A single captured camera frame. Published once by the capture thread and
+// then shared read-only by every consumer, so it must never be modified after
+// publish(). Frames come from the capture thread's RecyclingPool and are
+// reused once every consumer has dropped them.
+struct CapturedFrame {
+  cv::Mat image;
+  uint64_t sequence = 0;  // 1-based, strictly increasing
+  std::chrono::steady_clock::time_point capture_time;
+};
+
+using FramePtr = std::shared_ptr<const CapturedFrame>;
+
+// Fixed-size ring of reference-counted frames with one producer (the capture
+// thread) and any number of consumers. Each consumer keeps its own cursor (the
+// sequence number of the last frame it consumed) and reads at its own pace;
+// nothing a consumer does can hold up the producer. A consumer that falls more
+// than `capacity` frames behind silently skips forward to the oldest frame
+// still in the ring.
+class FrameBus {
+ public:
+  explicit FrameBus(size_t capacity);
+
+  // Producer side. Assigns the next sequence number and wakes any waiters.
+  void publish(std::shared_ptr<CapturedFrame> frame,
+               std::chrono::steady_clock::time_point captureTime);
+
+  // Returns the next frame after `cursor` and advances `cursor` to it. Waits up
+  // to `timeout` for one to arrive; returns nullptr on timeout.
+  FramePtr waitNext(uint64_t& cursor, std::chrono::milliseconds timeout);
+
+  // Like waitNext() but skips straight to the newest frame. Used by consumers
+  // that only ever want to show the most recent picture (live view).
+  FramePtr waitLatest(uint64_t& cursor, std::chrono::milliseconds timeout);
+
+  // Sequence number of the most recently published frame (0 if none yet).
+  uint64_t head() const { return head_.load(std::memory_order_acquire); }
+
+ private:
+  FramePtr slotFor(uint64_t sequence) const;
+  bool waitForNewerThan(uint64_t cursor, std::chrono::milliseconds timeout);
+
+  std::vector<FramePtr> slots_;  // Accessed only via std::atomic_load/store
+  std::atomic<uint64_t> head_{0};
+
+  // Only used to park consumers that have caught up with the producer; the
+  // publish/read fast path never blocks on it.
+  std::mutex waitMutex_;
+  std::condition_variable frameAvailable_;
+};
+
+#endif /* FRAME_BUS */
@@ -0,0 +1,287 @@
+#include "frameExport.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace {
+
+int64_t nanosSinceEpoch(std::chrono::nanoseconds sinceEpoch) {
+  return static_cast<int64_t>(sinceEpoch.count());
+}
+
+}  // namespace
+
+FrameExport::FrameExport(cv::Size frameSize, size_t slotCount)
+    : frameSize_(frameSize), slotCount_(slotCount) {}
+
+FrameExport::~FrameExport() {
+  for (int fd : consumerFds_) close(fd);
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+    unlink(socketPath_.c_str());
+  }
+  if (eventFd_ >= 0) close(eventFd_);
+  if (map_) munmap(map_, mapBytes_);
+  if (readOnlyFd_ >= 0) close(readOnlyFd_);
+  if (memFd_ >= 0) close(memFd_);
+}
+
+bool FrameExport::open(const std::string& socketPath) {
+  if (frameSize_.area() <= 0 || slotCount_ == 0) return false;
+  socketPath_ = socketPath;
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t stride = static_cast<size_t>(frameSize_.width) * 3;
+  size_t slotBytes = FRAME_EXPORT_PIXELS_OFFSET + stride * frameSize_.height;
+  slotBytes = (slotBytes + page - 1) / page * page;
+  size_t slotsOffset = (sizeof(FrameExportHeader) + page - 1) / page * page;
+  mapBytes_ = slotsOffset + slotBytes * slotCount_;
+
+  // Pages are only backed once written, i.e. once a consumer has attached.
+  memFd_ = memfd_create("motion-frame-export",
+                        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memFd_ < 0 || ftruncate(memFd_, static_cast<off_t>(mapBytes_)) != 0) {
+    perror("[FrameExport] Cannot create shared memory");
+    return false;
+  }
+  void* map = mmap(nullptr, mapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   memFd_, 0);
+  if (map == MAP_FAILED) {
+    perror("[FrameExport] Cannot map shared memory");
+    return false;
+  }
+  map_ = static_cast<uint8_t*>(map);
+  // A consumer that could shrink the memfd would crash us with SIGBUS. The
+  // write seal is separate since kernels before 5.1 reject it with EINVAL.
+  if (fcntl(memFd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+    perror("[FrameExport] Cannot seal shared memory");
+    return false;
+  }
+#ifdef F_SEAL_FUTURE_WRITE
+  // Our own mapping stays writable.
+  if (fcntl(memFd_, F_ADD_SEALS, F_SEAL_FUTURE_WRITE) != 0) {
+    perror("[FrameExport] Warning: Cannot seal shared memory against writes");
+  }
+#endif
+  fcntl(memFd_, F_ADD_SEALS, F_SEAL_SEAL);
+  // Consumers get a descriptor opened read-only, so they can't map the ring
+  // writable whatever the seals.
+  readOnlyFd_ = ::open(("/proc/self/fd/" + std::to_string(memFd_)).c_str(),
+                       O_RDONLY | O_CLOEXEC);
+  if (readOnlyFd_ < 0) {
+    perror("[FrameExport] Cannot reopen shared memory read-only");
+    return false;
+  }
+
+  header_ = new (map_) FrameExportHeader();
+  std::memcpy(header_->magic, FRAME_EXPORT_MAGIC, sizeof(header_->magic));
+  header_->version = FRAME_EXPORT_VERSION;
+  header_->slot_count = static_cast<uint32_t>(slotCount_);
+  header_->width = static_cast<uint32_t>(frameSize_.width);
+  header_->height = static_cast<uint32_t>(frameSize_.height);
+  header_->stride = static_cast<uint32_t>(stride);
+  header_->slot_bytes = slotBytes;
+  header_->slots_offset = slotsOffset;
+  header_->head.store(0, std::memory_order_release);
+
+  eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd_ < 0) {
+    perror("[FrameExport] eventfd creation failed");
+    return false;
+  }
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socketPath_.size() >= sizeof(address.sun_path)) {
+    std::cerr << "[FrameExport] Error: Socket path too long: " << socketPath_
+              << std::endl;
+    return false;
+  }
+  std::strncpy(address.sun_path, socketPath_.c_str(),
+               sizeof(address.sun_path) - 1);
+  unlink(socketPath_.c_str());  // Left behind by a previous run
+  listenFd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                     0);
+  if (listenFd_ < 0 ||
+      bind(listenFd_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listenFd_, 8) != 0) {
+    perror(("[FrameExport] Cannot listen on " + socketPath_).c_str());
+    if (listenFd_ >= 0) close(listenFd_);
+    listenFd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void FrameExport::offer(FramePtr frame, const FrameMotion& motion) {
+  if (consumers() == 0) return;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (pending_) framesReplaced_.fetch_add(1, std::memory_order_relaxed);
+    pending_ = std::move(frame);
+    pendingMotion_ = motion;
+  }
+  uint64_t one = 1;
+  if (write(eventFd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    perror("[FrameExport] eventfd write failed");
+  }
+}
+
+void FrameExport::stop() {
+  stopping_.store(true, std::memory_order_relaxed);
+  uint64_t one = 1;
+  if (eventFd_ >= 0 && write(eventFd_, &one, sizeof(one)) < 0) {
+    perror("[FrameExport] eventfd write failed");
+  }
+}
+
+// Hands the new consumer the memfd and the size to map.
+void FrameExport::acceptConsumer() {
+  while (true) {
+    int fd = accept4(listenFd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    uint64_t size = mapBytes_;
+    iovec payload{&size, sizeof(size)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(rights), &readOnlyFd_, sizeof(int));
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) != sizeof(size)) {
+      perror("[FrameExport] Failed to hand over shared memory");
+      close(fd);
+      continue;
+    }
+    consumerFds_.push_back(fd);
+    consumers_.store(static_cast<int>(consumerFds_.size()),
+                     std::memory_order_relaxed);
+    std::cout << "[FrameExport] Consumer attached to " << socketPath_ << " ("
+              << consumerFds_.size() << " now)." << std::endl;
+  }
+}
+
+void FrameExport::exportFrame(const CapturedFrame& frame,
+                              const FrameMotion& motion) {
+  if (frame.image.cols != frameSize_.width ||
+      frame.image.rows != frameSize_.height ||
+      frame.image.type() != CV_8UC3) {
+    return;  // Only possible if the source changed its mode
+  }
+  uint64_t position = position_ + 1;
+  auto* slot = reinterpret_cast<FrameExportSlot*>(
+      map_ + header_->slots_offset +
+      (position - 1) % slotCount_ * header_->slot_bytes);
+
+  // Readers that load the old position after this see the slot as gone.
+  slot->position.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  auto captureAge = std::chrono::steady_clock::now() - frame.capture_time;
+  slot->frame_sequence = frame.sequence;
+  slot->capture_unix_ns = nanosSinceEpoch(
+      std::chrono::system_clock::now().time_since_epoch() - captureAge);
+  slot->capture_monotonic_ns =
+      nanosSinceEpoch(frame.capture_time.time_since_epoch());
+  slot->motion = motion.changed_pixels;
+  slot->motion_x = static_cast<uint16_t>(motion.bounds.x);
+  slot->motion_y = static_cast<uint16_t>(motion.bounds.y);
+  slot->motion_width = static_cast<uint16_t>(motion.bounds.width);
+  slot->motion_height = static_cast<uint16_t>(motion.bounds.height);
+  uint8_t* pixels = reinterpret_cast<uint8_t*>(slot) +
+                    FRAME_EXPORT_PIXELS_OFFSET;
+  size_t rowBytes = header_->stride;
+  for (int row = 0; row < frame.image.rows; ++row) {
+    std::memcpy(pixels + row * rowBytes, frame.image.ptr(row), rowBytes);
+  }
+
+  slot->position.store(position, std::memory_order_release);
+  header_->head.store(position, std::memory_order_release);
+  position_ = position;
+  framesExported_.fetch_add(1, std::memory_order_relaxed);
+  notifyConsumers(position);
+}
+
+// A wakeup only; a consumer whose socket is full just misses it.
+void FrameExport::notifyConsumers(uint64_t position) {
+  for (int fd : consumerFds_) {
+    send(fd, &position, sizeof(position), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+}
+
+void FrameExport::run() {
+  if (listenFd_ < 0) return;
+  std::cout << "[FrameExport] Exporting frames on " << socketPath_ << " ("
+            << slotCount_ << " slots, " << mapBytes_ / (1024 * 1024)
+            << " MiB)." << std::endl;
+
+  std::vector<pollfd> fds;
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    fds.clear();
+    fds.push_back({eventFd_, POLLIN, 0});
+    fds.push_back({listenFd_, POLLIN, 0});
+    for (int fd : consumerFds_) fds.push_back({fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("[FrameExport] poll failed");
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) acceptConsumer();
+
+    // Consumers never send anything, so readable means gone.
+    std::vector<int> gone;
+    for (size_t i = 2; i < fds.size(); ++i) {
+      if (fds[i].revents != 0) gone.push_back(fds[i].fd);
+    }
+    for (int fd : gone) {
+      close(fd);
+      consumerFds_.erase(
+          std::find(consumerFds_.begin(), consumerFds_.end(), fd));
+      consumers_.store(static_cast<int>(consumerFds_.size()),
+                       std::memory_order_relaxed);
+      std::cout << "[FrameExport] Consumer detached from " << socketPath_
+                << " (" << consumerFds_.size() << " left)." << std::endl;
+    }
+    if (!gone.empty() && consumerFds_.empty()) {
+      std::lock_guard<std::mutex> lock(pendingMutex_);
+      pending_.reset();  // Back to the pool; nobody will take it
+    }
+
+    if (fds[0].revents & POLLIN) {
+      uint64_t counter;
+      while (read(eventFd_, &counter, sizeof(counter)) > 0) {
+      }
+      FramePtr frame;
+      FrameMotion motion;
+      {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        frame = std::move(pending_);
+        pending_.reset();
+        motion = pendingMotion_;
+      }
+      if (frame && !consumerFds_.empty()) exportFrame(*frame, motion);
+    }
+  }
+  std::cout << "[FrameExport] Exiting frame export loop." << std::endl;
+}
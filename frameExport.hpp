@@ -0,0 +1,84 @@
+#ifndef FRAME_EXPORT
+#define FRAME_EXPORT
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "frameBus.hpp"
+#include "frameExportProtocol.hpp"
+#include "motionTimeline.hpp"
+
+// Publishes a camera's frames to other processes on the same machine, so
+// extra analytics can run without opening the camera a second time. The
+// detector offer()s each frame with its motion result. This class's export
+// thread (run()) copies it into a ring in a memfd that consumers map
+// read-only. Consumers attach over a Unix socket, and the layout and read
+// protocol are described in frameExportProtocol.hpp.
+//
+// Nothing here waits for a consumer. A slow consumer finds its frames
+// overwritten and sees that in the positions. If the export thread itself
+// falls behind, only the newest offered frame is kept. While no consumer is
+// attached, offer() returns at once and nothing is copied.
+class FrameExport {
+ public:
+  FrameExport(cv::Size frameSize, size_t slotCount);
+  ~FrameExport();
+  FrameExport(const FrameExport&) = delete;
+  FrameExport& operator=(const FrameExport&) = delete;
+
+  // Creates the shared ring and starts listening on `socketPath`. The
+  // export is off (run() returns at once) unless this succeeded, so it must
+  // be called before run() starts.
+  bool open(const std::string& socketPath);
+
+  // Export thread entry point. Returns after stop().
+  void run();
+  void stop();
+
+  // Detector side; never blocks.
+  void offer(FramePtr frame, const FrameMotion& motion);
+
+  int consumers() const { return consumers_.load(std::memory_order_relaxed); }
+  uint64_t framesExported() const {
+    return framesExported_.load(std::memory_order_relaxed);
+  }
+  // Offered frames replaced by a newer one before the export thread got to
+  // them
+  uint64_t framesReplaced() const {
+    return framesReplaced_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void acceptConsumer();
+  void exportFrame(const CapturedFrame& frame, const FrameMotion& motion);
+  void notifyConsumers(uint64_t position);
+
+  std::string socketPath_;
+  const cv::Size frameSize_;
+  const size_t slotCount_;
+
+  int memFd_ = -1;
+  int readOnlyFd_ = -1;  // The same memfd, as handed to consumers
+  int listenFd_ = -1;
+  int eventFd_ = -1;  // Written by offer() and stop()
+  uint8_t* map_ = nullptr;
+  size_t mapBytes_ = 0;
+  FrameExportHeader* header_ = nullptr;
+
+  std::mutex pendingMutex_;
+  FramePtr pending_;  // Newest offered frame not yet exported
+  FrameMotion pendingMotion_;
+  std::atomic<bool> stopping_{false};
+
+  std::vector<int> consumerFds_;  // Export thread only
+  uint64_t position_ = 0;         // Export thread only
+  std::atomic<int> consumers_{0};
+  std::atomic<uint64_t> framesExported_{0};
+  std::atomic<uint64_t> framesReplaced_{0};
+};
+
+#endif /* FRAME_EXPORT */
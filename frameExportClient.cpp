@@ -0,0 +1,152 @@
+#include "frameExportClient.hpp"
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameExportClient::~FrameExportClient() {
+  disconnect();
+  if (map_) munmap(const_cast<uint8_t*>(map_), mapBytes_);
+}
+
+void FrameExportClient::disconnect() {
+  if (socketFd_ >= 0) close(socketFd_);
+  socketFd_ = -1;
+}
+
+bool FrameExportClient::connect(const std::string& socketPath) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    std::cerr << "[FrameExportClient] Error: Socket path too long: "
+              << socketPath << std::endl;
+    return false;
+  }
+  std::strncpy(address.sun_path, socketPath.c_str(),
+               sizeof(address.sun_path) - 1);
+  socketFd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (socketFd_ < 0 ||
+      ::connect(socketFd_, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) != 0) {
+    perror(("[FrameExportClient] Cannot connect to " + socketPath).c_str());
+    disconnect();
+    return false;
+  }
+
+  uint64_t size = 0;
+  iovec payload{&size, sizeof(size)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  int memFd = -1;
+  if (recvmsg(socketFd_, &message, MSG_CMSG_CLOEXEC) == sizeof(size)) {
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    if (rights && rights->cmsg_level == SOL_SOCKET &&
+        rights->cmsg_type == SCM_RIGHTS) {
+      std::memcpy(&memFd, CMSG_DATA(rights), sizeof(int));
+    }
+  }
+  if (memFd < 0 || size < sizeof(FrameExportHeader)) {
+    std::cerr << "[FrameExportClient] Error: No shared memory from "
+              << socketPath << "." << std::endl;
+    if (memFd >= 0) close(memFd);
+    disconnect();
+    return false;
+  }
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, memFd, 0);
+  close(memFd);  // The mapping keeps it alive
+  if (map == MAP_FAILED) {
+    perror("[FrameExportClient] Cannot map shared memory");
+    disconnect();
+    return false;
+  }
+  map_ = static_cast<const uint8_t*>(map);
+  mapBytes_ = size;
+  header_ = reinterpret_cast<const FrameExportHeader*>(map_);
+
+  if (std::memcmp(header_->magic, FRAME_EXPORT_MAGIC,
+                  sizeof(header_->magic)) != 0 ||
+      header_->version != FRAME_EXPORT_VERSION ||
+      header_->slot_count == 0 ||
+      header_->slots_offset + header_->slot_count * header_->slot_bytes >
+          mapBytes_ ||
+      FRAME_EXPORT_PIXELS_OFFSET +
+              static_cast<uint64_t>(header_->stride) * header_->height >
+          header_->slot_bytes) {
+    std::cerr << "[FrameExportClient] Error: " << socketPath
+              << " does not export frames in a format this client knows."
+              << std::endl;
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+bool FrameExportClient::waitForFrame(int timeoutMs) {
+  if (socketFd_ < 0) return false;
+  pollfd fd{socketFd_, POLLIN, 0};
+  int ready = poll(&fd, 1, timeoutMs);
+  if (ready < 0 && errno != EINTR) {
+    perror("[FrameExportClient] poll failed");
+    disconnect();
+    return false;
+  }
+  if (ready <= 0) return false;
+
+  // The messages only say that something happened; the header says what.
+  uint64_t position;
+  while (true) {
+    ssize_t n = recv(socketFd_, &position, sizeof(position), MSG_DONTWAIT);
+    if (n > 0) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (n < 0 && errno == EINTR) continue;
+    disconnect();  // Producer closed the socket
+    return false;
+  }
+}
+
+bool FrameExportClient::next(Frame& frame) {
+  if (!header_) return false;
+  uint64_t head = header_->head.load(std::memory_order_acquire);
+  if (head == 0) return false;
+  if (nextPosition_ == 0) nextPosition_ = head;  // Start with the newest
+  if (head >= nextPosition_ + header_->slot_count) {
+    missed_ += head - nextPosition_;  // A whole ring behind
+    nextPosition_ = head;
+  }
+
+  for (; nextPosition_ <= head; ++nextPosition_) {
+    uint64_t position = nextPosition_;
+    const auto* slot = reinterpret_cast<const FrameExportSlot*>(
+        map_ + header_->slots_offset +
+        (position - 1) % header_->slot_count * header_->slot_bytes);
+    // Otherwise the producer has lapped us since head was read.
+    if (slot->position.load(std::memory_order_acquire) != position) {
+      ++missed_;
+      continue;
+    }
+    ++nextPosition_;
+    frame.position = position;
+    frame.slot = slot;
+    frame.pixels =
+        reinterpret_cast<const uint8_t*>(slot) + FRAME_EXPORT_PIXELS_OFFSET;
+    return true;
+  }
+  return false;
+}
+
+bool FrameExportClient::stillValid(const Frame& frame) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return frame.slot->position.load(std::memory_order_relaxed) ==
+         frame.position;
+}
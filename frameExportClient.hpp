@@ -0,0 +1,68 @@
+#ifndef FRAME_EXPORT_CLIENT
+#define FRAME_EXPORT_CLIENT
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frameExportProtocol.hpp"
+
+// Consumer side of a camera's frame export, for programs that want its frames
+// without OpenCV or the rest of motion_detect. It implements the read protocol
+// in frameExportProtocol.hpp:
+//
+//   FrameExportClient client;
+//   if (!client.connect("/tmp/motion_export_cam0.sock")) ...
+//   while (client.connected()) {
+//     client.waitForFrame(1000);
+//     FrameExportClient::Frame frame;
+//     while (client.next(frame)) {
+//       ... read frame.slot and frame.pixels ...
+//       if (!client.stillValid(frame)) ... discard what was read ...
+//     }
+//   }
+//
+// Frames are handed out in order. A consumer that falls a whole ring behind
+// skips to the newest frame, and the frames it skipped are counted in
+// missed().
+class FrameExportClient {
+ public:
+  struct Frame {
+    uint64_t position = 0;
+    const FrameExportSlot* slot = nullptr;
+    const uint8_t* pixels = nullptr;  // height rows of stride bytes, BGR
+  };
+
+  FrameExportClient() = default;
+  ~FrameExportClient();
+  FrameExportClient(const FrameExportClient&) = delete;
+  FrameExportClient& operator=(const FrameExportClient&) = delete;
+
+  // Attaches to the producer listening on `socketPath` and maps its ring.
+  bool connect(const std::string& socketPath);
+
+  // Waits up to `timeoutMs` (-1: forever) for the producer to announce a
+  // frame. Returns false on timeout or once the producer has gone away.
+  bool waitForFrame(int timeoutMs);
+
+  // The next unread frame, if one is complete. It stays valid to read until
+  // the producer wraps around to its slot, so check stillValid() afterwards.
+  bool next(Frame& frame);
+  bool stillValid(const Frame& frame) const;
+
+  const FrameExportHeader& header() const { return *header_; }
+  bool connected() const { return socketFd_ >= 0; }
+  uint64_t missed() const { return missed_; }
+
+ private:
+  void disconnect();
+
+  int socketFd_ = -1;
+  const uint8_t* map_ = nullptr;
+  size_t mapBytes_ = 0;
+  const FrameExportHeader* header_ = nullptr;
+  uint64_t nextPosition_ = 0;  // 0 until the first frame
+  uint64_t missed_ = 0;
+};
+
+#endif /* FRAME_EXPORT_CLIENT */
@@ -0,0 +1,75 @@
+#ifndef FRAME_EXPORT_PROTOCOL
+#define FRAME_EXPORT_PROTOCOL
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Shared memory layout of a camera's frame export (see FrameExport), for
+// consumer processes. It has no dependencies, so other programs can include
+// it as-is. Everything is in the host's byte order.
+//
+// A consumer connects to the camera's Unix socket (SOCK_SEQPACKET) and
+// receives one message: a uint64_t with the size of the mapping, and the
+// memfd itself as SCM_RIGHTS ancillary data, opened read-only, so the
+// consumer can only map it read-only. The producer seals it against resizing
+// and, where the kernel supports it, against writable mappings by anyone
+// else. After that the producer sends
+// one message (the new head position, a uint64_t) per exported frame.
+// These are only a wakeup: they are dropped for a consumer that doesn't read
+// them, and the shared header is always the authority.
+//
+// The mapping starts with a FrameExportHeader, followed by `slot_count`
+// slots of `slot_bytes` each from `slots_offset`. Exported frames are
+// numbered by position 1, 2, 3... without gaps, and position p lives in slot
+// (p - 1) % slot_count. A slot is a FrameExportSlot followed by the pixels
+// at FRAME_EXPORT_PIXELS_OFFSET: `height` rows of `stride` bytes, 8-bit BGR.
+//
+// The producer never waits for anyone, so a slot may be rewritten while it is
+// being read. To read position p:
+//   1. load slot.position (acquire); if it is not p, the frame is gone
+//      (an overrun; skip ahead) or not written yet;
+//   2. use the metadata and pixels;
+//   3. issue an acquire fence and load slot.position again. If it is still
+//      p, everything read in step 2 was consistent; otherwise drop it.
+// Positions below head - slot_count + 1 have been overwritten: the difference
+// to the position a reader wanted is the number of frames it missed.
+const char FRAME_EXPORT_MAGIC[8] = {'M', 'O', 'T', 'N', 'F', 'R', 'M', 'S'};
+const uint32_t FRAME_EXPORT_VERSION = 1;
+const size_t FRAME_EXPORT_PIXELS_OFFSET = 64;  // Within a slot
+
+struct FrameExportHeader {
+  char magic[8];  // FRAME_EXPORT_MAGIC
+  uint32_t version;  // FRAME_EXPORT_VERSION
+  uint32_t slot_count;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;  // Bytes per pixel row
+  uint32_t reserved;
+  uint64_t slot_bytes;    // Distance between slots, a multiple of the page
+  uint64_t slots_offset;  // Offset of slot 0 within the mapping
+  std::atomic<uint64_t> head;  // Newest complete position, 0 before any
+};
+
+struct FrameExportSlot {
+  // Position of the frame in the slot, or 0 while it is being rewritten
+  std::atomic<uint64_t> position;
+  uint64_t frame_sequence;  // Sequence on the camera's frame bus
+  int64_t capture_unix_ns;  // Wall clock
+  int64_t capture_monotonic_ns;  // CLOCK_MONOTONIC
+  // Pixels that changed, in full-resolution units; -1 if the detector did
+  // not analyse this frame (see the governor's analysis stride)
+  int32_t motion;
+  // Bounding box of the active tiles, all 0 if none
+  uint16_t motion_x;
+  uint16_t motion_y;
+  uint16_t motion_width;
+  uint16_t motion_height;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "positions are shared between processes");
+static_assert(sizeof(FrameExportSlot) <= FRAME_EXPORT_PIXELS_OFFSET,
+              "slot metadata must fit before the pixels");
+
+#endif /* FRAME_EXPORT_PROTOCOL */
@@ -0,0 +1,238 @@
+#include "frameSource.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "defines.hpp"
+
+namespace {
+
+// Sleeps until frame `index` of a stream started at `start` is due and
+// returns 0. If the caller is so late that later frames are due as well, it
+// returns how many frames to skip to be back on schedule instead. Deadlines
+// are absolute, so time spent processing is never added to the period.
+long long paceFrame(std::chrono::steady_clock::time_point start,
+                    long long index, double fps) {
+  auto now = std::chrono::steady_clock::now();
+  auto current = static_cast<long long>(
+      std::chrono::duration<double>(now - start).count() * fps);
+  if (current > index) return current - index;
+  auto due = start + std::chrono::duration_cast<
+                         std::chrono::steady_clock::duration>(
+                         std::chrono::duration<double>(index / fps));
+  std::this_thread::sleep_until(due);
+  return 0;
+}
+
+double sanitizeFps(double fps) {
+  return (fps <= 0 || fps > 60) ? CAP_FPS : fps;  // Sanity check
+}
+
+}  // namespace
+
+// --- CameraSource ---
+
+bool CameraSource::open() {
+  std::cout << "Attempting to open camera index: " << index_ << std::endl;
+  std::cout << "Requested Resolution: " << CAP_WIDTH << "x" << CAP_HEIGHT
+            << " @ " << CAP_FPS << "FPS" << std::endl;
+
+  cap_.open(index_);
+  if (!cap_.isOpened()) {
+    // Try GStreamer pipeline as a fallback for Raspberry Pi
+    std::string gstPipeline =
+        "v4l2src device=/dev/video" + std::to_string(index_) +
+        " ! video/x-raw,width=" + std::to_string(static_cast<int>(CAP_WIDTH)) +
+        ",height=" + std::to_string(static_cast<int>(CAP_HEIGHT)) +
+        ",framerate=" + std::to_string(static_cast<int>(CAP_FPS)) + "/1" +
+        " ! videoconvert ! appsink";
+    std::cout << "Camera index " << index_
+              << " failed. Trying GStreamer: " << gstPipeline << std::endl;
+    cap_.open(gstPipeline, cv::CAP_GSTREAMER);
+  }
+
+  if (!cap_.isOpened()) {
+    std::cerr << "Error: Could not open camera using index " << index_
+              << " or GStreamer." << std::endl;
+    return false;
+  }
+
+  // Set camera parameters (some might not be settable if using GStreamer
+  // pipeline string directly)
+  cap_.set(cv::CAP_PROP_FRAME_WIDTH, CAP_WIDTH);
+  cap_.set(cv::CAP_PROP_FRAME_HEIGHT, CAP_HEIGHT);
+  // cap_.set(cv::CAP_PROP_FPS, CAP_FPS);
+
+  size_ = cv::Size(static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                   static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  fps_ = sanitizeFps(cap_.get(cv::CAP_PROP_FPS));
+  return true;
+}
+
+bool CameraSource::read(cv::Mat& frame) {
+  return cap_.read(frame) && !frame.empty();  // Paced by the camera itself
+}
+
+std::string CameraSource::description() const {
+  return "camera " + std::to_string(index_);
+}
+
+// --- FileSource ---
+
+bool FileSource::open() {
+  if (!cap_.open(path_)) {
+    std::cerr << "Error: Could not open video file " << path_ << std::endl;
+    return false;
+  }
+  size_ = cv::Size(static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                   static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  fps_ = sanitizeFps(cap_.get(cv::CAP_PROP_FPS));
+  frameIndex_ = 0;
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool FileSource::read(cv::Mat& frame) {
+  if (realtime_) {
+    // grab() skips a frame without converting it; at the end of the file the
+    // read below rewinds as usual.
+    long long late = paceFrame(start_, frameIndex_, fps_);
+    addMissedDeadlines(static_cast<uint64_t>(late));
+    for (; late > 0 && cap_.grab(); --late) frameIndex_++;
+    frameIndex_ += late;
+  }
+  if (!cap_.read(frame) || frame.empty()) {
+    if (!loop_) return false;
+    // Rewind; pacing continues from the same clock so the rate stays steady.
+    cap_.set(cv::CAP_PROP_POS_FRAMES, 0);
+    if (!cap_.read(frame) || frame.empty()) return false;
+  }
+  frameIndex_++;
+  return true;
+}
+
+std::string FileSource::description() const {
+  return "file " + path_ + (realtime_ ? " (real time)" : " (fast)");
+}
+
+// --- SyntheticSource ---
+
+bool SyntheticSource::open() {
+  if (size_.width <= 0 || size_.height <= 0 || fps_ <= 0) return false;
+
+  // Smooth blocky texture so blur and thresholds behave like a real scene.
+  background_.create(size_.height, size_.width, CV_8UC3);
+  for (int y = 0; y < size_.height; ++y) {
+    uchar* row = background_.ptr<uchar>(y);
+    for (int x = 0; x < size_.width; ++x) {
+      int cell = (x / 32) * 7 + (y / 32) * 13;
+      row[3 * x] = static_cast<uchar>(60 + (cell * 17) % 120);
+      row[3 * x + 1] = static_cast<uchar>(60 + (cell * 29) % 120);
+      row[3 * x + 2] = static_cast<uchar>(60 + (cell * 41) % 120);
+    }
+  }
+  frameIndex_ = 0;
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+void SyntheticSource::render(long long index, cv::Mat& frame) const {
+  background_.copyTo(frame);
+
+  // Low-amplitude sensor noise, well under THRESHOLD_VALUE, seeded by the
+  // frame number. One value per 4 bytes keeps generation cheap.
+  unsigned seed = static_cast<unsigned>(index) * 2654435761u + 1u;
+  for (int y = 0; y < frame.rows; ++y) {
+    uchar* row = frame.ptr<uchar>(y);
+    for (int x = 0; x + 4 <= frame.cols * 3; x += 4) {
+      seed = seed * 1664525u + 1013904223u;
+      int noise = static_cast<int>(seed >> 30) - 1;  // -1, 0, 1, 2
+      for (int i = 0; i < 4; ++i) {
+        row[x + i] = cv::saturate_cast<uchar>(row[x + i] + noise);
+      }
+    }
+  }
+
+  double t = index / fps_;
+  for (const auto& event : events_) {
+    if (t < event.start_seconds || t >= event.end_seconds) continue;
+    // A block crosses the frame from left to right over the event.
+    double progress =
+        (t - event.start_seconds) / (event.end_seconds - event.start_seconds);
+    int blockW = size_.width / 8, blockH = size_.height / 4;
+    int x = static_cast<int>(progress * (size_.width - blockW));
+    cv::rectangle(frame, cv::Rect(x, size_.height / 2 - blockH / 2, blockW,
+                                  blockH),
+                  cv::Scalar(40, 40, 220), cv::FILLED);
+  }
+}
+
+bool SyntheticSource::read(cv::Mat& frame) {
+  if (realtime_) {
+    long long late = paceFrame(start_, frameIndex_, fps_);
+    addMissedDeadlines(static_cast<uint64_t>(late));
+    frameIndex_ += late;
+  }
+  render(frameIndex_++, frame);
+  return true;
+}
+
+std::string SyntheticSource::description() const {
+  std::ostringstream out;
+  out << "synthetic " << size_.width << "x" << size_.height << "@" << fps_
+      << " with " << events_.size() << " motion event(s)"
+      << (realtime_ ? " (real time)" : " (fast)");
+  return out.str();
+}
+
+// --- Factory ---
+
+std::unique_ptr<FrameSource> createFrameSource(const std::string& spec,
+                                               bool realtime) {
+  size_t colon = spec.find(':');
+  std::string kind = spec.substr(0, colon);
+  std::string args = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+  if (kind == "camera") {
+    int index = args.empty() ? CAMERA_INDEX : std::atoi(args.c_str());
+    return std::unique_ptr<FrameSource>(new CameraSource(index));
+  }
+  if (kind == "file" && !args.empty()) {
+    return std::unique_ptr<FrameSource>(new FileSource(args, realtime, true));
+  }
+  if (kind == "synthetic") {
+    int width = static_cast<int>(CAP_WIDTH);
+    int height = static_cast<int>(CAP_HEIGHT);
+    double fps = CAP_FPS;
+    std::vector<SyntheticSource::MotionEvent> events;
+
+    colon = args.find(':');
+    std::string geometry = args.substr(0, colon);
+    std::string script =
+        colon == std::string::npos ? "" : args.substr(colon + 1);
+    if (geometry.find('x') == std::string::npos) {
+      script = args;  // "synthetic:5-8" with default geometry
+    } else if (std::sscanf(geometry.c_str(), "%dx%d@%lf", &width, &height,
+                           &fps) < 2) {
+      return nullptr;
+    }
+
+    std::istringstream scriptStream(script);
+    std::string range;
+    while (std::getline(scriptStream, range, ',')) {
+      SyntheticSource::MotionEvent event{};
+      if (std::sscanf(range.c_str(), "%lf-%lf", &event.start_seconds,
+                      &event.end_seconds) != 2 ||
+          event.end_seconds <= event.start_seconds) {
+        return nullptr;
+      }
+      events.push_back(event);
+    }
+    return std::unique_ptr<FrameSource>(new SyntheticSource(
+        cv::Size(width, height), fps, std::move(events), realtime));
+  }
+  return nullptr;
+}
@@ -0,0 +1,129 @@
+#ifndef FRAME_SOURCE
+#define FRAME_SOURCE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Where frames come from. The capture loop only talks to this interface, so
+// the pipeline can run from a camera, a recorded file or a generator.
+class FrameSource {
+ public:
+  virtual ~FrameSource() = default;
+
+  virtual bool open() = 0;
+  // Blocks until the next frame is due and decodes it into `frame`, reusing
+  // its buffer if it already has the right size. Returns false on error or
+  // end of input.
+  virtual bool read(cv::Mat& frame) = 0;
+
+  // Valid after a successful open().
+  virtual double fps() const = 0;
+  virtual cv::Size frameSize() const = 0;
+  virtual std::string description() const = 0;
+
+  // Frames skipped because their deadline had already passed when read()
+  // got to them. Only paced sources count these; a camera drops late frames
+  // in its driver. Safe from any thread.
+  uint64_t missedDeadlines() const {
+    return missedDeadlines_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  void addMissedDeadlines(uint64_t count) {
+    missedDeadlines_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> missedDeadlines_{0};
+};
+
+// V4L2 camera through OpenCV, with a GStreamer pipeline as fallback for the
+// Raspberry Pi camera stack.
+class CameraSource : public FrameSource {
+ public:
+  explicit CameraSource(int index) : index_(index) {}
+  bool open() override;
+  bool read(cv::Mat& frame) override;
+  double fps() const override { return fps_; }
+  cv::Size frameSize() const override { return size_; }
+  std::string description() const override;
+
+ private:
+  int index_;
+  cv::VideoCapture cap_;
+  double fps_ = 0;
+  cv::Size size_;
+};
+
+// Replays a video file, either paced at its own frame rate (like a camera) or
+// as fast as it decodes, optionally looping at the end.
+class FileSource : public FrameSource {
+ public:
+  FileSource(std::string path, bool realtime, bool loop)
+      : path_(std::move(path)), realtime_(realtime), loop_(loop) {}
+  bool open() override;
+  bool read(cv::Mat& frame) override;
+  double fps() const override { return fps_; }
+  cv::Size frameSize() const override { return size_; }
+  std::string description() const override;
+
+ private:
+  std::string path_;
+  bool realtime_;
+  bool loop_;
+  cv::VideoCapture cap_;
+  double fps_ = 0;
+  cv::Size size_;
+  long long frameIndex_ = 0;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Deterministic generator: a fixed textured background with low-amplitude
+// noise, plus a block sweeping across the scene during scripted motion events.
+// Frame n is a pure function of n, so runs are exactly reproducible.
+class SyntheticSource : public FrameSource {
+ public:
+  struct MotionEvent {
+    double start_seconds;
+    double end_seconds;
+  };
+
+  SyntheticSource(cv::Size size, double fps, std::vector<MotionEvent> events,
+                  bool realtime)
+      : size_(size), fps_(fps), events_(std::move(events)),
+        realtime_(realtime) {}
+  bool open() override;
+  bool read(cv::Mat& frame) override;
+  double fps() const override { return fps_; }
+  cv::Size frameSize() const override { return size_; }
+  std::string description() const override;
+
+  // Renders frame `index` without pacing; used by read() and the benchmarks.
+  void render(long long index, cv::Mat& frame) const;
+
+ private:
+  cv::Size size_;
+  double fps_;
+  std::vector<MotionEvent> events_;
+  bool realtime_;
+  cv::Mat background_;
+  long long frameIndex_ = 0;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Builds a source from a --source specification:
+//   camera[:INDEX]                      V4L2 camera (default CAMERA_INDEX)
+//   file:PATH                           replay a recording, looping
+//   synthetic[:WxH[@FPS]][:S-E,S-E...]  generator with motion in [S, E) secs
+// `realtime` selects camera-like pacing for file and synthetic sources;
+// otherwise they deliver frames as fast as they can be produced. Returns
+// nullptr for an unrecognised specification.
+std::unique_ptr<FrameSource> createFrameSource(const std::string& spec,
+                                               bool realtime);
+
+#endif /* FRAME_SOURCE */
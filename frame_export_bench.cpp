@@ -0,0 +1,231 @@
+// Frame export throughput benchmark. Publishes synthetic frames through a
+// FrameExport to consumer processes forked from this one, and checks that
+// the producer never waits for them: one consumer keeps up, the others can be
+// made slow, and each verifies every frame it reads against a stamp in its
+// pixels.
+//
+// Usage: frame_export_bench [options]
+//   --socket=PATH      export socket (default /tmp/frame_export_bench.sock)
+//   --size=WxH         frame size (default CAP_WIDTH x CAP_HEIGHT)
+//   --frames=N         frames offered (default 3000)
+//   --fps=N            offer rate; 0 offers each frame as soon as the
+//                      previous one is in the ring (default 0)
+//   --consumers=N      consumer processes (default 2)
+//   --slow-ms=N        per-frame work of every consumer but the first
+//                      (default 50)
+//   --slots=N          ring size (default FRAME_EXPORT_RING_FRAMES)
+//
+// Output is one JSON object per consumer (frames read, missed, torn reads
+// caught by the protocol, and corrupt frames that got past it, which must be
+// 0), then one for the producer: frames offered, exported and replaced, the
+// export rate in frames and MB per second, and offer() latency.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.hpp"
+#include "frameExport.hpp"
+#include "frameExportClient.hpp"
+#include "recyclingPool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+  std::string socketPath = "/tmp/frame_export_bench.sock";
+  cv::Size size{static_cast<int>(CAP_WIDTH), static_cast<int>(CAP_HEIGHT)};
+  long long frames = 3000;
+  double fps = 0;
+  int consumers = 2;
+  int slowMs = 50;
+  size_t slots = FRAME_EXPORT_RING_FRAMES;
+};
+
+// The frame's sequence goes into its first and last 8 pixel bytes, so a
+// consumer can tell a frame that was rewritten while it read it.
+void stamp(cv::Mat& image, uint64_t sequence) {
+  std::memcpy(image.ptr(0), &sequence, sizeof(sequence));
+  std::memcpy(image.ptr(image.rows - 1) + image.cols * 3 - sizeof(sequence),
+              &sequence, sizeof(sequence));
+}
+
+int runConsumer(int index, const BenchOptions& options) {
+  FrameExportClient client;
+  for (int attempt = 0; !client.connect(options.socketPath); ++attempt) {
+    if (attempt == 50) return 1;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  const FrameExportHeader& header = client.header();
+  size_t lastOffset = static_cast<size_t>(header.height - 1) * header.stride +
+                      header.width * 3 - sizeof(uint64_t);
+  int workMs = index == 0 ? 0 : options.slowMs;
+
+  uint64_t frames = 0, torn = 0, corrupt = 0;
+  FrameExportClient::Frame frame;
+  while (client.connected()) {
+    client.waitForFrame(1000);
+    while (client.next(frame)) {
+      uint64_t sequence = frame.slot->frame_sequence;
+      uint64_t first, last;
+      std::memcpy(&first, frame.pixels, sizeof(first));
+      std::memcpy(&last, frame.pixels + lastOffset, sizeof(last));
+      if (workMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(workMs));
+      }
+      if (!client.stillValid(frame)) {
+        ++torn;
+        continue;
+      }
+      ++frames;
+      if (first != sequence || last != sequence) ++corrupt;
+    }
+  }
+  std::cout << "{\"consumer\":" << index << ",\"work_ms\":" << workMs
+            << ",\"frames\":" << frames << ",\"missed\":" << client.missed()
+            << ",\"torn\":" << torn << ",\"corrupt\":" << corrupt << "}"
+            << std::endl;
+  return corrupt == 0 ? 0 : 1;
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+  return values[rank];
+}
+
+int runProducer(const BenchOptions& options,
+                std::unique_ptr<FrameExport> exporter,
+                const std::vector<pid_t>& children) {
+  std::thread exportThread(&FrameExport::run, exporter.get());
+
+  auto waitStart = Clock::now();
+  while (exporter->consumers() < options.consumers &&
+         Clock::now() - waitStart < std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  RecyclingPool<CapturedFrame> frames(options.slots + 8);
+  std::vector<double> offerMicros;
+  offerMicros.reserve(static_cast<size_t>(options.frames));
+  auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.fps > 0 ? 1.0 / options.fps : 0));
+  FrameMotion motion;
+  motion.changed_pixels = 0;
+
+  auto start = Clock::now();
+  auto deadline = start;
+  for (long long n = 1; n <= options.frames; ++n) {
+    if (options.fps > 0) std::this_thread::sleep_until(deadline);
+    deadline += period;
+    std::shared_ptr<CapturedFrame> frame = frames.acquire();
+    frame->image.create(options.size, CV_8UC3);  // No-op once allocated
+    frame->sequence = static_cast<uint64_t>(n);
+    frame->capture_time = Clock::now();
+    stamp(frame->image, frame->sequence);
+
+    auto offerStart = Clock::now();
+    exporter->offer(std::move(frame), motion);
+    offerMicros.push_back(std::chrono::duration<double, std::micro>(
+                              Clock::now() - offerStart)
+                              .count());
+    while (options.fps <= 0 && exporter->consumers() > 0 &&
+           exporter->framesExported() < static_cast<uint64_t>(n)) {
+      std::this_thread::yield();
+    }
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  // The last offered frame may still be on its way into the ring.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  uint64_t exported = exporter->framesExported();
+  uint64_t replaced = exporter->framesReplaced();
+  exporter->stop();
+  exportThread.join();
+  exporter.reset();  // Closes the sockets, which ends the consumers
+
+  bool consumersOk = true;
+  for (pid_t child : children) {
+    int status = 0;
+    waitpid(child, &status, 0);
+    consumersOk = consumersOk && WIFEXITED(status) &&
+                  WEXITSTATUS(status) == 0;
+  }
+
+  double frameMB = options.size.area() * 3 / 1e6;
+  std::cout << "{\"producer\":true,\"size\":\"" << options.size.width << "x"
+            << options.size.height << "\",\"slots\":" << options.slots
+            << ",\"offered\":" << options.frames
+            << ",\"exported\":" << exported << ",\"replaced\":" << replaced
+            << ",\"seconds\":" << elapsed
+            << ",\"export_fps\":" << exported / elapsed
+            << ",\"export_mb_per_s\":" << exported * frameMB / elapsed
+            << ",\"offer_us_p50\":" << percentile(offerMicros, 50)
+            << ",\"offer_us_p99\":" << percentile(offerMicros, 99)
+            << ",\"offer_us_max\":" << percentile(offerMicros, 100) << "}"
+            << std::endl;
+  return consumersOk ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    int w, h;
+    if (arg.rfind("--socket=", 0) == 0) {
+      options.socketPath = arg.substr(9);
+    } else if (std::sscanf(arg.c_str(), "--size=%dx%d", &w, &h) == 2 &&
+               w > 0 && h > 0) {
+      options.size = cv::Size(w, h);
+    } else if (arg.rfind("--frames=", 0) == 0) {
+      options.frames = std::atoll(arg.c_str() + 9);
+    } else if (arg.rfind("--fps=", 0) == 0) {
+      options.fps = std::atof(arg.c_str() + 6);
+    } else if (arg.rfind("--consumers=", 0) == 0) {
+      options.consumers = std::max(0, std::atoi(arg.c_str() + 12));
+    } else if (arg.rfind("--slow-ms=", 0) == 0) {
+      options.slowMs = std::max(0, std::atoi(arg.c_str() + 10));
+    } else if (arg.rfind("--slots=", 0) == 0 &&
+               std::atoi(arg.c_str() + 8) > 0) {
+      options.slots = static_cast<size_t>(std::atoi(arg.c_str() + 8));
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--socket=PATH] [--size=WxH] [--frames=N] [--fps=N]"
+                   " [--consumers=N] [--slow-ms=N] [--slots=N]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // The ring and socket exist before the fork, the export thread only after
+  // it, so the consumers start out as plain single-threaded processes.
+  auto exporter = std::make_unique<FrameExport>(options.size, options.slots);
+  if (!exporter->open(options.socketPath)) return 1;
+  std::cout.flush();
+  std::vector<pid_t> children;
+  for (int i = 0; i < options.consumers; ++i) {
+    pid_t child = fork();
+    if (child < 0) {
+      perror("fork");
+      return 1;
+    }
+    // _Exit: the child must not run the exporter's destructor.
+    if (child == 0) std::_Exit(runConsumer(i, options));
+    children.push_back(child);
+  }
+  return runProducer(options, std::move(exporter), children);
+}
@@ -0,0 +1,151 @@
+// Reference consumer of a camera's frame export (see FrameExportClient).
+// Prints once a second how many frames arrived, how many were missed or torn
+// and the latest motion result, and can save a frame as a PPM image. Use it
+// as a starting point for analytics that run in their own process.
+//
+// Usage: frame_export_consumer [options]
+//   --socket=PATH      the camera's export socket (default
+//                      /tmp/motion_export_cam0.sock)
+//   --snapshot=PATH    write the next complete frame to PATH and exit
+//   --seconds=N        stop after N seconds (default: run until the camera
+//                      goes away)
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "frameExportClient.hpp"
+
+namespace {
+
+// Copies the frame out and only keeps the copy if it was not torn.
+bool saveSnapshot(const FrameExportClient& client,
+                  const FrameExportClient::Frame& frame,
+                  const std::string& path) {
+  const FrameExportHeader& header = client.header();
+  std::vector<uint8_t> rgb(static_cast<size_t>(header.width) * 3 *
+                           header.height);
+  for (uint32_t row = 0; row < header.height; ++row) {
+    const uint8_t* in = frame.pixels + static_cast<size_t>(row) * header.stride;
+    uint8_t* out = rgb.data() + static_cast<size_t>(row) * header.width * 3;
+    for (uint32_t x = 0; x < header.width; ++x) {
+      out[3 * x] = in[3 * x + 2];  // BGR to RGB
+      out[3 * x + 1] = in[3 * x + 1];
+      out[3 * x + 2] = in[3 * x];
+    }
+  }
+  if (!client.stillValid(frame)) return false;
+
+  std::ofstream file(path, std::ios::binary);
+  file << "P6\n" << header.width << " " << header.height << "\n255\n";
+  file.write(reinterpret_cast<const char*>(rgb.data()),
+             static_cast<std::streamsize>(rgb.size()));
+  if (!file) {
+    std::cerr << "Error: Could not write " << path << std::endl;
+    std::exit(1);
+  }
+  std::cout << "Saved frame " << frame.slot->frame_sequence << " to " << path
+            << std::endl;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string socketPath = "/tmp/motion_export_cam0.sock";
+  std::string snapshotPath;
+  double seconds = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--socket=", 0) == 0) {
+      socketPath = arg.substr(9);
+    } else if (arg.rfind("--snapshot=", 0) == 0) {
+      snapshotPath = arg.substr(11);
+    } else if (arg.rfind("--seconds=", 0) == 0) {
+      seconds = std::atof(arg.c_str() + 10);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--socket=PATH] [--snapshot=PATH] [--seconds=N]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  FrameExportClient client;
+  if (!client.connect(socketPath)) return 1;
+  const FrameExportHeader& header = client.header();
+  std::cout << "Attached to " << socketPath << ": " << header.width << "x"
+            << header.height << ", " << header.slot_count << " slots"
+            << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  auto reportAt = start + std::chrono::seconds(1);
+  uint64_t frames = 0;
+  uint64_t torn = 0;
+  uint64_t reportedMissed = 0;
+  int64_t latencyNanos = 0;
+  FrameExportClient::Frame frame;
+  FrameExportSlot last{};
+  while (client.connected()) {
+    client.waitForFrame(1000);
+    while (client.next(frame)) {
+      if (!snapshotPath.empty()) {
+        if (saveSnapshot(client, frame, snapshotPath)) return 0;
+        ++torn;
+        continue;
+      }
+      // Metadata is copied field by field; the slot is not trivially
+      // copyable because of its atomic position.
+      FrameExportSlot copy{};
+      copy.frame_sequence = frame.slot->frame_sequence;
+      copy.capture_monotonic_ns = frame.slot->capture_monotonic_ns;
+      copy.motion = frame.slot->motion;
+      copy.motion_x = frame.slot->motion_x;
+      copy.motion_y = frame.slot->motion_y;
+      copy.motion_width = frame.slot->motion_width;
+      copy.motion_height = frame.slot->motion_height;
+      if (!client.stillValid(frame)) {
+        ++torn;
+        continue;
+      }
+      ++frames;
+      latencyNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count() -
+                     copy.capture_monotonic_ns;
+      last.frame_sequence = copy.frame_sequence;
+      last.motion = copy.motion;
+      last.motion_x = copy.motion_x;
+      last.motion_y = copy.motion_y;
+      last.motion_width = copy.motion_width;
+      last.motion_height = copy.motion_height;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= reportAt) {
+      std::cout << "frames=" << frames
+                << " missed=" << client.missed() - reportedMissed
+                << " torn=" << torn << " sequence=" << last.frame_sequence
+                << " latency_ms=" << latencyNanos / 1e6
+                << " motion=" << last.motion;
+      if (last.motion > 0) {
+        std::cout << " bounds=" << last.motion_width << "x"
+                  << last.motion_height << "+" << last.motion_x << "+"
+                  << last.motion_y;
+      }
+      std::cout << std::endl;
+      frames = torn = 0;
+      reportedMissed = client.missed();
+      reportAt += std::chrono::seconds(1);
+    }
+    if (seconds > 0 && now - start >= std::chrono::duration<double>(seconds)) {
+      return 0;
+    }
+  }
+  std::cout << "Camera went away." << std::endl;
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include "governor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "camera.hpp"
+#include "defines.hpp"
+#include "utils.hpp"
+
+namespace {
+
+// Level 0 is full quality; each step down trades a little more detection
+// latency and live picture quality for CPU time.
+const GovernorSettings LEVELS[] = {
+    {1, ANALYSIS_SCALE, LIVE_JPEG_QUALITY},
+    {2, ANALYSIS_SCALE, LIVE_JPEG_QUALITY - 15},
+    {2, ANALYSIS_SCALE * 2, LIVE_JPEG_QUALITY - 30},
+    {4, ANALYSIS_SCALE * 2, LIVE_JPEG_QUALITY - 40},
+};
+const int LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+int64_t nowTicks() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+}  // namespace
+
+Governor::Governor(std::string temperaturePath)
+    : temperaturePath_(std::move(temperaturePath)), temperature_(NAN) {}
+
+GovernorSettings Governor::settings() const { return LEVELS[level()]; }
+
+void Governor::notifyMotion() {
+  auto hold = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::seconds(GOVERNOR_MOTION_HOLD_SECONDS));
+  std::lock_guard<std::mutex> lock(levelMutex_);
+  motionHoldUntil_.store(nowTicks() + hold.count(), std::memory_order_relaxed);
+  if (level() != 0) setLevel(0, "motion");
+}
+
+void Governor::setLevel(int level, const char* reason) {
+  level_.store(level, std::memory_order_relaxed);
+  for (const auto& camera : gCameras) {
+    camera->live.setJpegQuality(LEVELS[level].live_jpeg_quality);
+  }
+  std::cout << "[Governor] Level " << level << " (" << reason
+            << "): analyse every " << LEVELS[level].analysis_stride
+            << " frame(s) at 1/" << LEVELS[level].analysis_scale
+            << " scale, live quality " << LEVELS[level].live_jpeg_quality
+            << std::endl;
+}
+
+// Busy share of all CPUs since the previous call, from the aggregate line of
+// /proc/stat. The first call only primes the counters.
+bool Governor::readCpuBusy(double& percent) {
+  std::ifstream stat("/proc/stat");
+  std::string cpu;
+  uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0,
+           softirq = 0, steal = 0;
+  if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait >> irq >>
+        softirq >> steal) ||
+      cpu != "cpu") {
+    return false;
+  }
+  uint64_t total = user + nice + system + idle + iowait + irq + softirq + steal;
+  uint64_t busy = total - idle - iowait;
+  bool primed = lastCpuTotal_ != 0 && total > lastCpuTotal_;
+  if (primed) {
+    percent = 100.0 * (busy - lastCpuBusy_) / (total - lastCpuTotal_);
+  }
+  lastCpuBusy_ = busy;
+  lastCpuTotal_ = total;
+  return primed;
+}
+
+void Governor::run() {
+  std::cout << "[Governor] Starting governor loop, temperature from "
+            << temperaturePath_ << std::endl;
+
+  while (true) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(GOVERNOR_INTERVAL_MS));
+
+    // Re-opened every time: sysfs values are only refreshed on open.
+    double temperature = NAN;
+    std::ifstream sensor(temperaturePath_);
+    long milliDegrees = 0;
+    if (sensor >> milliDegrees) temperature = milliDegrees / 1000.0;
+    temperature_.store(temperature, std::memory_order_relaxed);
+
+    double cpuPercent = 0;
+    bool haveCpu = readCpuBusy(cpuPercent);
+
+    uint64_t skipped = gMetrics.detector_frames_skipped.value();
+    size_t queueDepth = 0;
+    for (const auto& camera : gCameras) {
+      queueDepth = std::max(queueDepth, camera->recorder.queueDepth());
+    }
+    bool backlog = skipped != lastSkipped_ ||
+                   queueDepth > RECORDER_QUEUE_CAPACITY / 2;
+    lastSkipped_ = skipped;
+
+    // An unreadable sensor (e.g. on a desktop) counts as neither hot nor cool.
+    bool hot = !std::isnan(temperature) && temperature >= GOVERNOR_TEMP_HIGH_C;
+    bool busy = haveCpu && cpuPercent >= GOVERNOR_CPU_HIGH_PERCENT;
+    bool calm = (std::isnan(temperature) ||
+                 temperature < GOVERNOR_TEMP_LOW_C) &&
+                (!haveCpu || cpuPercent < GOVERNOR_CPU_LOW_PERCENT) && !backlog;
+
+    std::lock_guard<std::mutex> lock(levelMutex_);
+    if (nowTicks() < motionHoldUntil_.load(std::memory_order_relaxed)) {
+      calmSamples_ = 0;  // Motion owns the quality for now
+      continue;
+    }
+
+    int current = level();
+    if ((hot || busy || backlog) && current + 1 < LEVEL_COUNT) {
+      calmSamples_ = 0;
+      std::ostringstream reason;
+      reason << (hot ? "hot " : "") << (busy ? "busy " : "")
+             << (backlog ? "backlog " : "") << temperature << "C "
+             << cpuPercent << "% cpu";
+      setLevel(current + 1, reason.str().c_str());
+    } else if (calm && current > 0) {
+      if (++calmSamples_ >= GOVERNOR_RECOVER_SAMPLES) {
+        calmSamples_ = 0;
+        setLevel(current - 1, "calm");
+      }
+    } else {
+      calmSamples_ = 0;
+    }
+  }
+  std::cout << "[Governor] Exiting governor loop." << std::endl;
+}
@@ -0,0 +1,69 @@
+#ifndef GOVERNOR
+#define GOVERNOR
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// What the pipeline should currently spend on each frame.
+struct GovernorSettings {
+  int analysis_stride;    // Analyse every Nth frame
+  int analysis_scale;     // MotionKernel decimation factor
+  int live_jpeg_quality;  // Quality of the /live stream
+};
+
+// Thermal- and load-aware quality governor. run() samples the CPU temperature
+// (a sysfs file in millidegrees, so tests can point it at a plain file), CPU
+// utilisation from /proc/stat and the detector's backlog every
+// GOVERNOR_INTERVAL_MS. Any pressure steps one level down; stepping back up
+// needs GOVERNOR_RECOVER_SAMPLES calm samples in a row below the low
+// thresholds, which gives the hysteresis. notifyMotion() jumps straight back
+// to full quality and holds it for GOVERNOR_MOTION_HOLD_SECONDS.
+//
+// Consumers poll settings() (a single atomic load) instead of being called
+// back, so the detector picks up changes at its next frame.
+class Governor {
+ public:
+  explicit Governor(std::string temperaturePath);
+
+  // Must be called before run() starts.
+  void setTemperaturePath(std::string path) {
+    temperaturePath_ = std::move(path);
+  }
+
+  // Governor thread entry point.
+  void run();
+
+  void notifyMotion();
+
+  GovernorSettings settings() const;
+  int level() const { return level_.load(std::memory_order_relaxed); }
+  // Last reading in degrees C, NaN if the sensor could not be read.
+  double temperature() const {
+    return temperature_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Caller holds levelMutex_.
+  void setLevel(int level, const char* reason);
+  bool readCpuBusy(double& percent);
+
+  std::string temperaturePath_;
+  // Serializes level changes from the governor thread and every camera's
+  // detector, so a step down can't overwrite motion's reset to full quality.
+  std::mutex levelMutex_;
+  std::atomic<int> level_{0};
+  std::atomic<double> temperature_;
+  std::atomic<int64_t> motionHoldUntil_{0};  // steady_clock ticks
+
+  // Sampler state, only touched by run()
+  uint64_t lastCpuBusy_ = 0;
+  uint64_t lastCpuTotal_ = 0;
+  uint64_t lastSkipped_ = 0;
+  int calmSamples_ = 0;
+};
+
+#endif /* GOVERNOR */
@@ -1,35 +1,447 @@
-#include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
-#include <thread>
+#include <unordered_map>
 
+#include "camera.hpp"
 #include "defines.hpp"
 #include "utils.hpp"
 
-void handleHttpClient(int clientFd) {
-  char buffer[2048] = {0};  // Increased buffer size
-  ssize_t bytesRead = read(clientFd, buffer, sizeof(buffer) - 1);
+namespace {
 
-  if (bytesRead <= 0) {
-    perror("[HttpServer] read error or client disconnected prematurely");
-    close(clientFd);
+// Returns the value of header `name` (case-insensitive) or "" if absent.
+std::string getHeader(const std::string& request, const std::string& name) {
+  std::istringstream lines(request);
+  std::string line;
+  std::getline(lines, line);  // Skip the request line
+  while (std::getline(lines, line) && line != "\r") {
+    size_t colon = line.find(':');
+    if (colon != name.size() ||
+        !std::equal(name.begin(), name.end(), line.begin(),
+                    [](char a, char b) {
+                      return std::tolower(a) == std::tolower(b);
+                    })) {
+      continue;
+    }
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    size_t end = line.find_last_not_of(" \t\r");
+    if (begin == std::string::npos || end < begin) return "";
+    return line.substr(begin, end - begin + 1);
+  }
+  return "";
+}
+
+// Parses a single-range "bytes=" header against a file of `size` bytes into
+// an inclusive [first, last]. Returns false if it cannot be satisfied.
+bool parseByteRange(const std::string& range, off_t size, off_t& first,
+                    off_t& last) {
+  const std::string prefix = "bytes=";
+  if (range.compare(0, prefix.size(), prefix) != 0 || size == 0) return false;
+  std::string spec = range.substr(prefix.size());
+  if (spec.find(',') != std::string::npos) return false;  // No multipart
+  size_t dash = spec.find('-');
+  if (dash == std::string::npos) return false;
+
+  std::string from = spec.substr(0, dash), to = spec.substr(dash + 1);
+  char* endp = nullptr;
+  if (from.empty()) {  // "-N": the last N bytes
+    long long suffix = std::strtoll(to.c_str(), &endp, 10);
+    if (to.empty() || *endp != '\0' || suffix <= 0) return false;
+    first = suffix >= size ? 0 : size - suffix;
+    last = size - 1;
+    return true;
+  }
+  first = std::strtoll(from.c_str(), &endp, 10);
+  if (*endp != '\0' || first < 0 || first >= size) return false;
+  last = size - 1;
+  if (!to.empty()) {
+    long long requestedLast = std::strtoll(to.c_str(), &endp, 10);
+    if (*endp != '\0' || requestedLast < first) return false;
+    last = std::min<off_t>(requestedLast, size - 1);
+  }
+  return true;
+}
+
+// Returns the value of `name` in a URL query string ("a=1&b=2"), or "" if it
+// is absent. Values are used as-is: none of ours need percent-decoding.
+std::string getQueryParam(const std::string& query, const std::string& name) {
+  std::istringstream pairs(query);
+  std::string pair;
+  while (std::getline(pairs, pair, '&')) {
+    size_t eq = pair.find('=');
+    if (pair.compare(0, eq, name) == 0 && eq == name.size()) {
+      return pair.substr(eq + 1);
+    }
+  }
+  return "";
+}
+
+// Parses an optional numeric query parameter. Returns false if it is present
+// but not a finite number; callers still clamp it before any integer cast.
+bool parseNumberParam(const std::string& query, const std::string& name,
+                      double& value) {
+  std::string text = getQueryParam(query, name);
+  if (text.empty()) return true;
+  char* endp = nullptr;
+  double parsed = std::strtod(text.c_str(), &endp);
+  if (*endp != '\0' || !std::isfinite(parsed)) return false;
+  value = parsed;
+  return true;
+}
+
+std::string formatLocalTime(int64_t unixMs, const char* format) {
+  time_t seconds = static_cast<time_t>(unixMs / 1000);
+  std::tm tm{};
+  localtime_r(&seconds, &tm);
+  char buf[64];
+  std::strftime(buf, sizeof(buf), format, &tm);
+  return buf;
+}
+
+// Tags ETags with the process start so a restart never revalidates a body
+// built by a previous run with the same generation number.
+const std::string gBootTag = std::to_string(time(nullptr));
+
+// Each camera's default /detections page (what the UI loads), serialized once
+// per generation (see serveDetections) instead of once per request.
+struct DetectionsCache {
+  struct Entry {
+    uint64_t generation = UINT64_MAX;
+    std::shared_ptr<const std::string> body;
+  };
+  std::mutex mutex;
+  std::unordered_map<int, Entry> cameras;
+} gDetectionsCache;
+
+// Camera 0 is served at the top level, as before there were several; camera
+// N's pages live under /cam/N.
+std::string cameraPrefix(const Camera& camera) {
+  return camera.id == 0 ? "" : "/cam/" + std::to_string(camera.id);
+}
+
+// Splits an optional /cam/<id> prefix off `path`. Returns nullptr if it
+// names a camera that does not exist.
+Camera* routeCamera(std::string& path) {
+  if (path.rfind("/cam/", 0) != 0) return findCamera(0);
+  size_t end = path.find('/', 5);
+  std::string id = path.substr(5, end == std::string::npos ? end : end - 5);
+  if (id.empty() || id.find_first_not_of("0123456789") != std::string::npos ||
+      id.size() > 4) {
+    return nullptr;
+  }
+  path = end == std::string::npos ? "/" : path.substr(end);
+  return findCamera(std::stoi(id));
+}
+
+std::string detectionJson(const Camera& camera, const DetectionRecord& det) {
+  std::string prefix = cameraPrefix(camera);
+  std::ostringstream json;
+  json << "{\"timestamp\":\""
+       << formatLocalTime(det.start_ms, "%Y-%m-%dT%H:%M:%SZ") << "\","
+       << "\"prettyTimestamp\":\""
+       << formatLocalTime(det.start_ms, "%Y-%m-%d %H:%M:%S") << "\","
+       << "\"videoFilename\":\"" << det.name() << "\","
+       << "\"startTime\":" << det.start_ms / 1000 << ","
+       << "\"durationSeconds\":" << det.duration_ms / 1000.0 << ","
+       << "\"frameCount\":" << det.frame_count << ","
+       << "\"motionScore\":" << det.motion_score << ","
+       << "\"camera\":" << camera.id << ","
+       << "\"videoUrl\":\"" << prefix << "/videos/" << det.name() << "\"";
+  if (det.flags & DetectionRecord::HAS_THUMBNAIL) {
+    json << ",\"thumbnailUrl\":\"" << prefix << "/thumbs/"
+         << ThumbnailCache::nameFor(det.name()) << "\"";
+  }
+  if (det.flags & DetectionRecord::HAS_TIMELINE) {
+    json << ",\"timelineUrl\":\"" << prefix << "/videos/" << det.name()
+         << "/timeline\"";
+  }
+  std::vector<ClipLabel> labels = camera.classifier.labels(det.name());
+  if (!labels.empty()) {
+    json << ",\"labels\":[";
+    for (size_t i = 0; i < labels.size(); ++i) {
+      json << (i ? "," : "") << "{\"label\":\"" << labels[i].label
+           << "\",\"confidence\":" << labels[i].confidence << "}";
+    }
+    json << "]";
+  }
+  json << "}";
+  return json.str();
+}
+
+std::string detectionsPageJson(const Camera& camera,
+                               const DetectionIndex::Query& query) {
+  DetectionIndex::Page page = camera.index.query(query);
+  std::string json = "{\"detections\":[";
+  for (size_t i = 0; i < page.records.size(); ++i) {
+    if (i) json += ",";
+    json += detectionJson(camera, page.records[i]);
+  }
+  json += "],\"nextCursor\":";
+  json += page.next_cursor >= 0 ? std::to_string(page.next_cursor) : "null";
+  json += "}";
+  return json;
+}
+
+// /detections?from=&to=&limit=&cursor= : one page of the index, newest first.
+// from/to are Unix seconds (inclusive); cursor is the nextCursor of the
+// previous page. Every response carries the index and classifier generations
+// as its ETag, so a poll with If-None-Match costs nothing while the list is
+// unchanged.
+void serveDetections(HttpConnection& conn, const std::string& query) {
+  const Camera& camera = *conn.camera;
+  std::ostringstream response;
+  // +-1e15 s keeps the millisecond conversion well inside int64_t.
+  double from = -1e15, to = 1e15, limit = DETECTIONS_PAGE_SIZE, cursor = -1;
+  if (!parseNumberParam(query, "from", from) ||
+      !parseNumberParam(query, "to", to) ||
+      !parseNumberParam(query, "limit", limit) ||
+      !parseNumberParam(query, "cursor", cursor)) {
+    response << "HTTP/1.1 400 Bad Request\r\nContent-Type: "
+                "text/plain\r\nConnection: close\r\n\r\nfrom, to, limit "
+                "and cursor must be numbers.";
+    conn.queue(response.str());
+    return;
+  }
+
+  // Read before the query: if the index changes in between, the body is
+  // newer than its tag and the next request simply refetches. Both counters
+  // only grow, so their sum changes whenever either does.
+  uint64_t generation =
+      camera.index.generation() + camera.classifier.generation();
+  std::string etag = "\"" + gBootTag + "-" + std::to_string(camera.id) + "-" +
+                     std::to_string(generation) + "\"";
+  std::string commonHeaders =
+      "Content-Type: application/json; charset=utf-8\r\n"
+      "Cache-Control: no-cache\r\n"
+      "ETag: " + etag + "\r\n" +
+      "Connection: close\r\n";
+  if (getHeader(conn.request, "If-None-Match") == etag) {
+    conn.queue("HTTP/1.1 304 Not Modified\r\n" + commonHeaders + "\r\n");
+    return;
+  }
+
+  std::shared_ptr<const std::string> body;
+  if (query.empty()) {
+    std::lock_guard<std::mutex> lock(gDetectionsCache.mutex);
+    DetectionsCache::Entry& cached = gDetectionsCache.cameras[camera.id];
+    if (cached.generation == generation) body = cached.body;
+  }
+  if (!body) {
+    DetectionIndex::Query indexQuery;
+    indexQuery.from_ms = static_cast<int64_t>(std::max(from, -1e15) * 1000);
+    indexQuery.to_ms = static_cast<int64_t>(std::min(to, 1e15) * 1000);
+    indexQuery.limit = static_cast<size_t>(
+        std::max(1.0, std::min<double>(limit, DETECTIONS_MAX_PAGE_SIZE)));
+    // Cursors are record positions; anything past 1e18 is past the end.
+    if (cursor >= 0) {
+      indexQuery.cursor = static_cast<uint64_t>(std::min(cursor, 1e18));
+    }
+    body = std::make_shared<const std::string>(
+        detectionsPageJson(camera, indexQuery));
+    if (query.empty()) {
+      std::lock_guard<std::mutex> lock(gDetectionsCache.mutex);
+      DetectionsCache::Entry& cached = gDetectionsCache.cameras[camera.id];
+      cached.generation = generation;
+      cached.body = body;
+    }
+  }
+
+  response << "HTTP/1.1 200 OK\r\n"
+           << "Content-Length: " << body->size() << "\r\n"
+           << commonHeaders << "\r\n";
+  conn.queue(response.str());
+  conn.queue(body, body->data(), body->size());  // Shared, not copied
+}
+
+std::string httpDate(time_t time) {
+  std::tm tm{};
+  gmtime_r(&time, &tm);
+  char buf[64];
+  std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buf;
+}
+
+// Streams a clip straight from the page cache with sendfile(), honouring a
+// single Range request so the browser player can seek without downloading
+// the whole file.
+void serveVideoFile(HttpConnection& conn, const std::string& fullFilepath) {
+  std::ostringstream response;
+  int fileFd = open(fullFilepath.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st {};
+  if (fileFd < 0 || fstat(fileFd, &st) < 0) {
+    if (fileFd >= 0) close(fileFd);
+    std::cerr << "[HttpServer] Video file not found on disk: " << fullFilepath
+              << std::endl;
+    response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
+                "text/plain\r\nConnection: close\r\n\r\nVideo file not "
+                "found on disk.";
+    conn.queue(response.str());
+    return;
+  }
+
+  std::ostringstream etag;
+  etag << '"' << std::hex << st.st_size << '-' << st.st_mtime << '"';
+  std::string commonHeaders = "Content-Type: video/avi\r\n"  // MJPEG in AVI
+                              "Accept-Ranges: bytes\r\n"
+                              "Last-Modified: " +
+                              httpDate(st.st_mtime) + "\r\n" +
+                              "ETag: " + etag.str() + "\r\n" +
+                              "Connection: close\r\n";
+
+  if (getHeader(conn.request, "If-None-Match") == etag.str()) {
+    close(fileFd);
+    conn.queue("HTTP/1.1 304 Not Modified\r\n" + commonHeaders + "\r\n");
+    return;
+  }
+
+  off_t first = 0, last = st.st_size - 1;
+  std::string range = getHeader(conn.request, "Range");
+  // A Range for an older version of the file (If-Range mismatch) gets the
+  // whole new file instead.
+  std::string ifRange = getHeader(conn.request, "If-Range");
+  if (!range.empty() && (ifRange.empty() || ifRange == etag.str())) {
+    if (!parseByteRange(range, st.st_size, first, last)) {
+      close(fileFd);
+      response << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+               << "Content-Range: bytes */" << st.st_size << "\r\n"
+               << "Content-Length: 0\r\n"
+               << commonHeaders << "\r\n";
+      conn.queue(response.str());
+      return;
+    }
+    response << "HTTP/1.1 206 Partial Content\r\n"
+             << "Content-Range: bytes " << first << "-" << last << "/"
+             << st.st_size << "\r\n";
+  } else {
+    response << "HTTP/1.1 200 OK\r\n";
+  }
+  response << "Content-Length: " << (st.st_size == 0 ? 0 : last - first + 1)
+           << "\r\n"
+           << commonHeaders << "\r\n";
+  conn.queue(response.str());
+
+  if (st.st_size == 0) {
+    close(fileFd);
     return;
   }
-  buffer[bytesRead] = '\0';  // Null-terminate the received data
+  conn.file_fd = fileFd;  // Closed by the server once sent or on disconnect
+  conn.file_offset = first;
+  conn.file_remaining = static_cast<size_t>(last - first + 1);
+}
+
+// Sends the timeline sidecar of `clipName` as JSON, one
+// [offsetMs, motion, x, y, width, height] array per frame, or with
+// ?format=binary as the file itself (see TimelineSample).
+void serveTimeline(HttpConnection& conn, const std::string& clipName,
+                   const std::string& query) {
+  static const char notFound[] =
+      "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nConnection: "
+      "close\r\n\r\nTimeline not found.";
+  std::string path =
+      conn.camera->recordings_dir + "/" + timelineNameFor(clipName);
+  std::ostringstream response;
 
-  std::istringstream req(buffer);
+  if (getQueryParam(query, "format") == "binary") {
+    int fileFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fileFd < 0 || fstat(fileFd, &st) < 0 || st.st_size == 0) {
+      if (fileFd >= 0) close(fileFd);
+      conn.queue(notFound);
+      return;
+    }
+    response << "HTTP/1.1 200 OK\r\n"
+             << "Content-Type: application/octet-stream\r\n"
+             << "Content-Length: " << st.st_size << "\r\n"
+             << "Cache-Control: max-age=86400\r\n"
+             << "Connection: close\r\n\r\n";
+    conn.queue(response.str());
+    conn.file_fd = fileFd;
+    conn.file_offset = 0;
+    conn.file_remaining = static_cast<size_t>(st.st_size);
+    return;
+  }
+
+  std::vector<TimelineSample> samples;
+  if (!readTimeline(path, samples)) {
+    conn.queue(notFound);
+    return;
+  }
+  int peakMotion = -1;
+  std::string body = "{\"videoFilename\":\"" + clipName + "\",\"samples\":[";
+  body.reserve(body.size() + samples.size() * 32);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const TimelineSample& s = samples[i];
+    peakMotion = std::max<int>(peakMotion, s.motion);
+    if (i) body += ',';
+    body += '[' + std::to_string(s.offset_ms) + ',' +
+            std::to_string(s.motion) + ',' + std::to_string(s.x) + ',' +
+            std::to_string(s.y) + ',' + std::to_string(s.width) + ',' +
+            std::to_string(s.height) + ']';
+  }
+  body += "],\"peakMotion\":" + std::to_string(peakMotion) + "}";
+  // Finished clips never change, and neither do their timelines.
+  response << "HTTP/1.1 200 OK\r\n"
+           << "Content-Type: application/json\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Cache-Control: max-age=86400\r\n"
+           << "Connection: close\r\n\r\n";
+  conn.queue(response.str());
+  conn.queue(std::move(body));
+}
+
+}  // namespace
+
+void handleHttpClient(HttpConnection& conn) {
+  std::istringstream req(conn.request);
   std::string method, path, version;
   req >> method >> path >> version;
 
   std::cout << "[HttpServer] Request: " << method << " " << path << std::endl;
+  gMetrics.http_requests.add();
+
+  std::string query;
+  size_t questionMark = path.find('?');
+  if (questionMark != std::string::npos) {
+    query = path.substr(questionMark + 1);
+    path.resize(questionMark);
+  }
 
   std::ostringstream response;
 
+  // Everything below serves the addressed camera; /metrics covers them all.
+  conn.camera = routeCamera(path);
+  if (!conn.camera) {
+    response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
+                "text/plain\r\nConnection: close\r\n\r\nNo such camera.";
+    conn.queue(response.str());
+    conn.state = HttpConnection::State::Writing;
+    return;
+  }
+  Camera& camera = *conn.camera;
+  std::string prefix = cameraPrefix(camera);
+
   if (method == "GET") {
     if (path == "/") {
+      std::string cameraLinks;
+      if (gCameras.size() > 1) {
+        cameraLinks = "<p>Cameras:";
+        for (const auto& other : gCameras) {
+          cameraLinks += " <a href='" + cameraPrefix(*other) + "/'>" +
+                         std::to_string(other->id) + "</a>";
+        }
+        cameraLinks += "</p>";
+      }
       response
           << "HTTP/1.1 200 OK\r\n"
           << "Content-Type: text/html; charset=utf-8\r\n"
@@ -46,214 +458,249 @@ void handleHttpClient(int clientFd) {
           << "#detectionsList { list-style-type: none; padding: 0; }"
           << "#detectionsList li { background-color: #e9ecef; margin-bottom: "
              "8px; padding: 10px; border-radius: 4px; }"
+          << "#detectionsList img { width: 160px; vertical-align: middle; "
+             "margin-right: 10px; border-radius: 4px; }"
           << "</style>"
           << "</head><body><div class='container'>"
-          << "<h1>Camera Control Panel</h1>"
-          << "<p><a href='/live'>View Live Stream</a> (stops motion "
-             "detection)</p>"
+          << "<h1>Camera " << camera.id << " Control Panel</h1>"
+          << cameraLinks
+          << "<p><a href='" << prefix << "/live'>View Live Stream</a> ("
+          << "<a href='" << prefix << "/live?w=320&fps=10'>low bandwidth</a>)"
+          << "</p>"
           << "<h2>Recent Motion Detections (Videos)</h2>"
           << "<ul id='detectionsList'></ul>"
           << "<script>"
+          << "function detectionItem(det) {"
+          << "  const item = document.createElement('li');"
+          << "  const thumb = det.thumbnailUrl ? "
+             "`<img src='${det.thumbnailUrl}' loading='lazy' alt=''>` : '';"
+          << "  const labels = (det.labels || []).map(l => "
+             "`${l.label} ${Math.round(l.confidence * 100)}%`).join(', ');"
+          << "  item.innerHTML = `${thumb}${det.prettyTimestamp} - <a "
+             "href='${det.videoUrl}' "
+             "target='_blank'>${det.videoFilename}</a>"
+             "${labels ? ' (' + labels + ')' : ''}`;"
+          << "  return item;"
+          << "}"
           << "function fetchDetections() {"
-          << "  fetch('/detections')"
+          << "  fetch('" << prefix << "/detections')"
           << "    .then(response => response.json())"
           << "    .then(data => {"
           << "      const list = document.getElementById('detectionsList');"
           << "      list.innerHTML = '';"  // Clear old list
-          << "      if (data.length === 0) { list.innerHTML = '<li>No "
-             "detections yet.</li>'; }"
-          << "      data.forEach(det => {"
-          << "        const item = document.createElement('li');"
-          << "        item.innerHTML = `${det.prettyTimestamp} - <a "
-             "href='/videos/${det.videoFilename}' "
-             "target='_blank'>${det.videoFilename}</a>`;"
-          << "        list.appendChild(item);"
-          << "      });"
+          << "      if (data.detections.length === 0) { list.innerHTML = "
+             "\"<li id='noDetections'>No detections yet.</li>\"; }"
+          << "      data.detections.forEach(det => "
+             "list.appendChild(detectionItem(det)));"
           << "    }).catch(err => { console.error('Error fetching "
              "detections:', err); const list = "
              "document.getElementById('detectionsList'); list.innerHTML = "
              "'<li>Error loading detections.</li>'; });"
           << "}"
-          << "fetchDetections(); setInterval(fetchDetections, 15000); // "
-             "Refresh every 15 seconds"
+          // New clips are pushed over /events. The full list is reloaded
+          // whenever the stream (re)connects, which also picks up clips
+          // deleted by retention in the meantime.
+          << "const events = new EventSource('" << prefix << "/events');"
+          << "events.onopen = fetchDetections;"
+          << "events.addEventListener('detection', e => {"
+          << "  const list = document.getElementById('detectionsList');"
+          << "  const empty = document.getElementById('noDetections');"
+          << "  if (empty) empty.remove();"
+          << "  list.insertBefore(detectionItem(JSON.parse(e.data)), "
+             "list.firstChild);"
+          << "});"
           << "</script>"
           << "</div></body></html>";
-      send(clientFd, response.str().c_str(), response.str().length(), 0);
+      conn.queue(response.str());
 
     } else if (path == "/live") {
+      // ?w= and ?q= pick the starting (and best) quality tier, ?fps= caps
+      // the frame rate; see HttpWorker::adaptLiveTier for the rest.
+      double width = 0, quality = 0, fps = 0;
+      if (!parseNumberParam(query, "w", width) ||
+          !parseNumberParam(query, "q", quality) ||
+          !parseNumberParam(query, "fps", fps)) {
+        response << "HTTP/1.1 400 Bad Request\r\nContent-Type: "
+                    "text/plain\r\nConnection: close\r\n\r\nw, q and fps "
+                    "must be numbers.";
+        conn.queue(response.str());
+        conn.state = HttpConnection::State::Writing;
+        return;
+      }
+      // Anything beyond these limits asks for no limit at all anyway.
+      width = std::max(0.0, std::min(width, 100000.0));
+      quality = std::max(0.0, std::min(quality, 100.0));
+      conn.live_tier = LiveStreamHub::tierFor(static_cast<int>(width),
+                                              static_cast<int>(quality));
+      conn.live_best_tier = conn.live_tier;
+      if (fps > 0) {
+        fps = std::max(fps, 0.01);  // One frame every 100 s at the least
+        // 7/8 of the period, so capture jitter can't make a 15 fps cap on a
+        // 30 fps camera skip every other due frame.
+        conn.live_min_interval =
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(0.875 / fps));
+      }
+      camera.live.addClient(conn.live_tier);
       gLiveStreamClientCount.fetch_add(1, std::memory_order_relaxed);
       gIsLiveStreamingActive.store(true, std::memory_order_relaxed);
-      std::cout << "[HttpServer] Live stream client connected. Active clients: "
+      std::cout << "[HttpServer] Live stream client connected to camera "
+                << camera.id << " (tier " << conn.live_tier
+                << "). Active clients: "
                 << gLiveStreamClientCount.load() << std::endl;
 
-      std::string boundary = "--FRAME_BOUNDARY";
       response << "HTTP/1.1 200 OK\r\n"
                << "Content-Type: multipart/x-mixed-replace; boundary="
-               << boundary << "\r\n"
+               << LIVE_STREAM_BOUNDARY << "\r\n"
                << "Connection: close\r\n"  // Keep-alive can be complex with raw
                                            // sockets and MJPEG
                << "Cache-Control: no-cache, no-store, must-revalidate\r\n"
                << "Pragma: no-cache\r\n"
                << "Expires: 0\r\n\r\n";
-
-      if (send(clientFd, response.str().c_str(), response.str().length(),
-               MSG_NOSIGNAL) < 0) {
-        perror("[HttpServer] Error sending live stream headers");
-      } else {
-        cv::Mat liveFrame;
-        std::vector<uchar> buf;
-        std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY,
-                                   90};  // JPEG quality
-
-        while (gIsLiveStreamingActive.load(
-            std::memory_order_relaxed)) {  // Check global flag too
-          {
-            std::lock_guard<std::mutex> lock(gCameraMutex);
-            if (!gCap.isOpened()) {
-              std::cerr << "[HttpServer] Live stream: Camera not available."
-                        << std::endl;
-              break;
-            }
-            gCap >> liveFrame;
-          }
-
-          if (liveFrame.empty()) {
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds(30));  // Wait if frame is empty
-            continue;
-          }
-
-          cv::imencode(".jpg", liveFrame, buf, params);
-
-          std::ostringstream frameHeader;
-          frameHeader << boundary << "\r\n"
-                      << "Content-Type: image/jpeg\r\n"
-                      << "Content-Length: " << buf.size() << "\r\n\r\n";
-
-          // Send frame header
-          if (send(clientFd, frameHeader.str().c_str(),
-                   frameHeader.str().length(), MSG_NOSIGNAL) < 0) {
-            // perror("[HttpServer] Live stream: send frame header failed");
-            std::cout
-                << "[HttpServer] Live stream client disconnected (header send)."
-                << std::endl;
-            break;
-          }
-          // Send frame data
-          if (send(clientFd, buf.data(), buf.size(), MSG_NOSIGNAL) < 0) {
-            // perror("[HttpServer] Live stream: send frame data failed");
-            std::cout
-                << "[HttpServer] Live stream client disconnected (data send)."
-                << std::endl;
-            break;
-          }
-          std::this_thread::sleep_for(
-              std::chrono::milliseconds(static_cast<long long>(
-                  1000.0 / CAP_FPS)));  // Stream at camera FPS
-        }
-      }
-
-      if (gLiveStreamClientCount.fetch_sub(1, std::memory_order_relaxed) == 1) {
-        gIsLiveStreamingActive.store(
-            false, std::memory_order_relaxed);  // Last client disconnected
-        std::cout << "[HttpServer] Last live stream client disconnected. "
-                     "Resuming motion detection."
-                  << std::endl;
-      } else {
-        std::cout
-            << "[HttpServer] Live stream client disconnected. Active clients: "
-            << gLiveStreamClientCount.load() << std::endl;
-      }
+      conn.queue(response.str());
+      // From here on the server appends the newest frame from the camera's
+      // live hub each time this connection's queue drains, see
+      // feedLiveStream().
+      conn.state = HttpConnection::State::Streaming;
+      return;
 
     } else if (path == "/detections") {
-      std::ostringstream jsonBody;
-      jsonBody << "[";
-      {
-        std::lock_guard<std::mutex> lock(gDetectionMutex);
-        for (size_t i = 0; i < gRecentDetections.size(); ++i) {
-          const auto& det = gRecentDetections[i];
-          jsonBody << "{\"timestamp\":\"" << det.timestamp << "\","
-                   << "\"prettyTimestamp\":\"" << det.pretty_timestamp << "\","
-                   << "\"videoFilename\":\"" << det.video_filename << "\"}";
-          if (i < gRecentDetections.size() - 1) jsonBody << ",";
-        }
-      }
-      jsonBody << "]";
+      serveDetections(conn, query);
 
+    } else if (path == "/events") {
+      // Server-sent events: one "detection" event per new clip, with the
+      // index position as id so a reconnecting browser resumes after the
+      // last event it saw (Last-Event-ID) instead of missing any.
+      uint64_t size = camera.index.size();
+      std::string lastEventId = getHeader(conn.request, "Last-Event-ID");
+      conn.event_cursor =
+          lastEventId.empty()
+              ? size
+              : std::min<uint64_t>(
+                    std::strtoull(lastEventId.c_str(), nullptr, 10), size);
+      conn.event_generation = UINT64_MAX;  // Check the index right away
       response << "HTTP/1.1 200 OK\r\n"
-               << "Content-Type: application/json; charset=utf-8\r\n"
-               << "Content-Length: " << jsonBody.str().length() << "\r\n"
+               << "Content-Type: text/event-stream\r\n"
+               << "Cache-Control: no-cache\r\n"
                << "Connection: close\r\n\r\n"
-               << jsonBody.str();
-      send(clientFd, response.str().c_str(), response.str().length(), 0);
+               << "retry: 5000\n\n";
+      conn.queue(response.str());
+      conn.state = HttpConnection::State::EventStream;
+      return;
+
+    } else if (path == "/metrics") {
+      // Only atomics are read here, never the detection index lock, so
+      // scraping can't stall the pipeline.
+      std::string body = renderMetrics();
+      response << "HTTP/1.1 200 OK\r\n"
+               << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+               << "Content-Length: " << body.length() << "\r\n"
+               << "Connection: close\r\n\r\n"
+               << body;
+      conn.queue(response.str());
+
+    } else if (path.rfind("/thumbs/", 0) == 0) {
+      std::string name = sanitizeFilename(path.substr(8));
+      ThumbnailCache::Jpeg jpeg;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".jpg") == 0) {
+        jpeg = camera.thumbnails.get(name);
+      }
+      if (!jpeg) {
+        response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
+                    "text/plain\r\nConnection: close\r\n\r\nThumbnail not "
+                    "found.";
+        conn.queue(response.str());
+      } else {
+        // A clip's thumbnail never changes, so browsers may keep it.
+        response << "HTTP/1.1 200 OK\r\n"
+                 << "Content-Type: image/jpeg\r\n"
+                 << "Content-Length: " << jpeg->size() << "\r\n"
+                 << "Cache-Control: max-age=86400\r\n"
+                 << "Connection: close\r\n\r\n";
+        conn.queue(response.str());
+        conn.queue(jpeg, jpeg->data(), jpeg->size());
+      }
 
     } else if (path.rfind("/videos/", 0) ==
                0) {  // Check if path starts with /videos/
       std::string requestedFileBase = path.substr(8);  // Length of "/videos/"
-      std::string safeFilename = sanitizeFilename(requestedFileBase);
-      std::string fullFilepath = RECORDINGS_DIR + "/" + safeFilename;
-
-      bool foundInDetections = false;
-      {
-        std::lock_guard<std::mutex> lock(gDetectionMutex);
-        for (const auto& det : gRecentDetections) {
-          if (det.video_filename == safeFilename) {
-            foundInDetections = true;
-            break;
-          }
-        }
+      const std::string timelineSuffix = "/timeline";
+      bool timeline =
+          requestedFileBase.size() > timelineSuffix.size() &&
+          requestedFileBase.compare(
+              requestedFileBase.size() - timelineSuffix.size(),
+              timelineSuffix.size(), timelineSuffix) == 0;
+      if (timeline) {
+        requestedFileBase.resize(requestedFileBase.size() -
+                                 timelineSuffix.size());
       }
+      std::string safeFilename = sanitizeFilename(requestedFileBase);
+      std::string fullFilepath = camera.recordings_dir + "/" + safeFilename;
 
-      if (!foundInDetections) {
+      if (!camera.index.contains(safeFilename)) {
         std::cerr
-            << "[HttpServer] Video file not in recent detections or unsafe: "
+            << "[HttpServer] Video file not in detection index or unsafe: "
             << requestedFileBase << std::endl;
         response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
                     "text/plain\r\nConnection: close\r\n\r\nVideo not found or "
                     "access denied.";
-        send(clientFd, response.str().c_str(), response.str().length(), 0);
+        conn.queue(response.str());
+      } else if (timeline) {
+        serveTimeline(conn, safeFilename, query);
       } else {
-        std::ifstream file(fullFilepath, std::ios::binary | std::ios::ate);
-        if (file.is_open()) {
-          std::streamsize size = file.tellg();
-          file.seekg(0, std::ios::beg);
-          std::vector<char> videoBuffer(size);
-          if (file.read(videoBuffer.data(), size)) {
-            response
-                << "HTTP/1.1 200 OK\r\n"
-                << "Content-Type: video/avi\r\n"  // Assuming MJPEG is in AVI
-                << "Content-Length: " << size << "\r\n"
-                << "Connection: close\r\n\r\n";
-            send(clientFd, response.str().c_str(), response.str().length(), 0);
-            send(clientFd, videoBuffer.data(), size, 0);
-          } else {
-            std::cerr << "[HttpServer] Error reading video file: "
-                      << fullFilepath << std::endl;
-            response << "HTTP/1.1 500 Internal Server Error\r\nContent-Type: "
-                        "text/plain\r\nConnection: close\r\n\r\nError reading "
-                        "video file.";
-            send(clientFd, response.str().c_str(), response.str().length(), 0);
-          }
-          file.close();
-        } else {
-          std::cerr << "[HttpServer] Video file not found on disk: "
-                    << fullFilepath << std::endl;
-          response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
-                      "text/plain\r\nConnection: close\r\n\r\nVideo file not "
-                      "found on disk.";
-          send(clientFd, response.str().c_str(), response.str().length(), 0);
-        }
+        serveVideoFile(conn, fullFilepath);
       }
     } else {
       response << "HTTP/1.1 404 Not Found\r\nContent-Type: "
                   "text/plain\r\nConnection: close\r\n\r\nEndpoint not found.";
-      send(clientFd, response.str().c_str(), response.str().length(), 0);
+      conn.queue(response.str());
     }
   } else {
     response << "HTTP/1.1 405 Method Not Allowed\r\nContent-Type: "
                 "text/plain\r\nConnection: close\r\n\r\nMethod not allowed.";
-    send(clientFd, response.str().c_str(), response.str().length(), 0);
+    conn.queue(response.str());
+  }
+  conn.state = HttpConnection::State::Writing;
+}
+
+// Queues any detections after conn.event_cursor as SSE events. Returns false
+// if there was nothing to send. The generation check keeps the frequent
+// wakeups caused by live frames from touching the index at all.
+bool feedDetectionEvents(HttpConnection& conn) {
+  const size_t batch = 16;
+  const Camera& camera = *conn.camera;
+  uint64_t generation = camera.index.generation();
+  if (generation == conn.event_generation) return false;
+
+  DetectionIndex::Page page = camera.index.since(conn.event_cursor, batch);
+  conn.event_cursor = static_cast<uint64_t>(page.next_cursor);
+  if (page.records.size() < batch) conn.event_generation = generation;
+  if (page.records.empty()) return false;
+
+  std::string events;
+  for (size_t i = 0; i < page.records.size(); ++i) {
+    events += "id: " + std::to_string(page.positions[i] + 1) +
+              "\nevent: detection\ndata: " +
+              detectionJson(camera, page.records[i]) +
+              "\n\n";
   }
+  conn.queue(std::move(events));
+  conn.last_activity = std::chrono::steady_clock::now();
+  return true;
+}
 
-  close(clientFd);
+void handleHttpClientClosed(HttpConnection& conn) {
+  if (conn.state != HttpConnection::State::Streaming) return;
+
+  conn.camera->live.removeClient(conn.live_tier);
+  if (gLiveStreamClientCount.fetch_sub(1, std::memory_order_relaxed) == 1) {
+    gIsLiveStreamingActive.store(
+        false, std::memory_order_relaxed);  // Last client disconnected
+    std::cout << "[HttpServer] Last live stream client disconnected."
+              << std::endl;
+  } else {
+    std::cout
+        << "[HttpServer] Live stream client disconnected. Active clients: "
+        << gLiveStreamClientCount.load() << std::endl;
+  }
 }
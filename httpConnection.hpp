@@ -0,0 +1,70 @@
+#ifndef HTTP_CONNECTION
+#define HTTP_CONNECTION
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+// A piece of response data waiting to be written. `owner` keeps the bytes
+// alive, which lets shared buffers (e.g. an encoded live frame) be queued on
+// many connections without copying them.
+struct OutChunk {
+  std::shared_ptr<const void> owner;
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+struct Camera;
+
+// Per-connection state for the epoll server. A connection reads until it has
+// a complete request header, is handed to handleHttpClient(), then drains its
+// output queue (followed by an optional file body) and is closed, or, for
+// /live and /events, stays open as a stream and is fed new frames or events
+// whenever its queue runs empty.
+struct HttpConnection {
+  enum class State { ReadingRequest, Writing, Streaming, EventStream };
+
+  int fd = -1;
+  State state = State::ReadingRequest;
+  std::string request;  // Raw request bytes received so far
+  std::deque<OutChunk> out;
+  bool want_write = false;  // EPOLLOUT currently registered
+  bool read_closed = false;  // Client shut down its sending side
+  Camera* camera = nullptr;  // Camera the request addressed
+  // Live streams: last frame queued, the quality tier currently sent and
+  // the best one the client asked for (see HttpWorker::adaptLiveTier), and
+  // the ?fps= cap as a minimum capture time distance between frames
+  uint64_t live_cursor = 0;
+  int live_tier = 0;
+  int live_best_tier = 0;
+  int live_calm_frames = 0;  // Frames sent in a row with an empty send queue
+  bool live_backed_up = false;  // Skipping frames until the queue drains
+  size_t live_last_bytes = 0;  // JPEG size of the last frame queued
+  std::chrono::steady_clock::duration live_min_interval{0};
+  std::chrono::steady_clock::time_point live_last_capture;
+  // Event streams: next detection index position to send, and the index
+  // generation it was last checked against
+  uint64_t event_cursor = 0;
+  uint64_t event_generation = 0;
+  // File body sent with sendfile() after `out` has drained (video downloads)
+  int file_fd = -1;
+  off_t file_offset = 0;
+  size_t file_remaining = 0;
+  std::chrono::steady_clock::time_point last_activity;
+
+  void queue(std::string data) {
+    auto owned = std::make_shared<std::string>(std::move(data));
+    queue(owned, owned->data(), owned->size());
+  }
+  void queue(std::shared_ptr<const void> owner, const void* data,
+             size_t size) {
+    if (size == 0) return;
+    out.push_back({std::move(owner), static_cast<const char*>(data), size});
+  }
+};
+
+#endif /* HTTP_CONNECTION */
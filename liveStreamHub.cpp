@@ -0,0 +1,142 @@
+#include "liveStreamHub.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#include "defines.hpp"
+#include "utils.hpp"
+
+namespace {
+
+struct LiveTier {
+  int width;  // 0: the camera's own width
+  int jpeg_quality;
+};
+
+// Best first. The smallest tier is meant for phones on a mobile connection
+// and needs well under a tenth of the bandwidth of the full one.
+const LiveTier LIVE_TIERS[] = {
+    {0, LIVE_JPEG_QUALITY},
+    {960, 75},
+    {640, 60},
+    {320, 45},
+};
+static_assert(sizeof(LIVE_TIERS) / sizeof(LIVE_TIERS[0]) ==
+                  LiveStreamHub::TIER_COUNT,
+              "LIVE_TIERS must have TIER_COUNT entries");
+
+}  // namespace
+
+LiveStreamHub::LiveStreamHub(FrameBus& bus, int jpegQuality)
+    : bus_(bus),
+      jpegQuality_(jpegQuality),
+      encodeParams_{cv::IMWRITE_JPEG_QUALITY, jpegQuality},
+      // One per connection that may still be sending, the newest of each
+      // tier and the one being encoded
+      encoded_(static_cast<size_t>(HTTP_MAX_CONNECTIONS) + TIER_COUNT + 1) {}
+
+int LiveStreamHub::tierFor(int maxWidth, int maxQuality) {
+  for (int tier = 0; tier < TIER_COUNT; ++tier) {
+    const LiveTier& t = LIVE_TIERS[tier];
+    bool fits = maxWidth <= 0 || (t.width > 0 && t.width <= maxWidth);
+    if (fits && (maxQuality <= 0 || t.jpeg_quality <= maxQuality)) {
+      return tier;
+    }
+  }
+  return TIER_COUNT - 1;
+}
+
+int LiveStreamHub::clients() const {
+  int total = 0;
+  for (const Tier& tier : tiers_) {
+    total += tier.clients.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void LiveStreamHub::notifyListeners() {
+  uint64_t one = 1;
+  std::lock_guard<std::mutex> lock(listenersMutex_);
+  for (int eventFd : listeners_) {
+    if (write(eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      perror("[LiveHub] eventfd write failed");
+    }
+  }
+}
+
+EncodedFramePtr LiveStreamHub::newestAfter(int tier, uint64_t cursor) const {
+  EncodedFramePtr frame = std::atomic_load(&tiers_[tier].latest);
+  if (frame && frame->sequence > cursor) return frame;
+  return nullptr;
+}
+
+void LiveStreamHub::addListener(int eventFd) {
+  std::lock_guard<std::mutex> lock(listenersMutex_);
+  listeners_.push_back(eventFd);
+}
+
+void LiveStreamHub::encode(int tier, const CapturedFrame& source) {
+  const LiveTier& settings = LIVE_TIERS[tier];
+  const cv::Mat* image = &source.image;
+  if (settings.width > 0 && settings.width < image->cols) {
+    // Even height keeps the aspect ratio and suits any decoder.
+    int height = (image->rows * settings.width / image->cols) & ~1;
+    cv::resize(*image, tiers_[tier].scaled, cv::Size(settings.width, height),
+               0, 0, cv::INTER_AREA);
+    image = &tiers_[tier].scaled;
+  }
+
+  std::shared_ptr<EncodedFrame> frame = encoded_.acquire();
+  frame->sequence = source.sequence;
+  frame->capture_time = source.capture_time;
+  encodeParams_[1] = std::min(settings.jpeg_quality,
+                              jpegQuality_.load(std::memory_order_relaxed));
+  auto encodeStart = std::chrono::steady_clock::now();
+  cv::imencode(".jpg", *image, frame->jpeg, encodeParams_);
+  gMetrics.encode_seconds.observe(std::chrono::steady_clock::now() -
+                                  encodeStart);
+  gMetrics.live_frames_encoded.add();
+  // Assembled in place so the string keeps its capacity.
+  frame->part_header.assign(LIVE_STREAM_BOUNDARY);
+  frame->part_header.append("\r\nContent-Type: image/jpeg\r\n"
+                            "Content-Length: ");
+  frame->part_header.append(std::to_string(frame->jpeg.size()));
+  frame->part_header.append("\r\n\r\n");
+  std::atomic_store(&tiers_[tier].latest, EncodedFramePtr(std::move(frame)));
+}
+
+void LiveStreamHub::run() {
+  uint64_t cursor = 0;  // Last bus sequence encoded
+
+  std::cout << "[LiveHub] Starting live stream encoder loop." << std::endl;
+
+  while (true) {
+    // Forget the last frame of tiers nobody watches, so the next viewer
+    // doesn't start on a picture that may be minutes old.
+    for (Tier& tier : tiers_) {
+      if (tier.clients.load(std::memory_order_relaxed) == 0 &&
+          std::atomic_load(&tier.latest)) {
+        std::atomic_store(&tier.latest, EncodedFramePtr());
+      }
+    }
+    if (clients() == 0) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(200));  // Nobody is watching
+      continue;
+    }
+
+    FramePtr source = bus_.waitLatest(cursor, std::chrono::seconds(1));
+    if (!source) continue;
+
+    for (int tier = 0; tier < TIER_COUNT; ++tier) {
+      if (clients(tier) > 0) encode(tier, *source);
+    }
+    notifyListeners();
+  }
+  std::cout << "[LiveHub] Exiting live stream encoder loop." << std::endl;
+}
@@ -0,0 +1,105 @@
+#ifndef LIVE_STREAM_HUB
+#define LIVE_STREAM_HUB
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frameBus.hpp"
+#include "recyclingPool.hpp"
+
+const std::string LIVE_STREAM_BOUNDARY = "--FRAME_BOUNDARY";
+
+// One JPEG-encoded camera frame together with its multipart part header, ready
+// to be written to any number of /live sockets as-is.
+struct EncodedFrame {
+  uint64_t sequence = 0;  // Sequence of the source frame on the camera's bus
+  std::chrono::steady_clock::time_point capture_time;  // Of the source frame
+  std::string part_header;
+  std::vector<uchar> jpeg;
+};
+
+using EncodedFramePtr = std::shared_ptr<const EncodedFrame>;
+
+// Encode-once, send-to-many MJPEG source with a few fixed quality tiers
+// (resolution and JPEG quality, see LIVE_TIERS in liveStreamHub.cpp). While a
+// tier has at least one client, run() encodes the newest frame from the bus
+// for it a single time and publishes the shared result; tiers nobody watches
+// cost nothing. Each subscriber keeps its own cursor and always picks up the
+// newest encoded frame of its tier, so a slow client skips frames instead of
+// queueing them and never slows down the others. Cursors are bus sequences,
+// which every tier shares, so a client can change tier between frames.
+// Listeners (the HTTP worker threads) are woken through an eventfd after every
+// frame. Encoded frames are recycled once no socket is still sending them, so
+// their JPEG and header buffers keep their capacity from frame to frame.
+class LiveStreamHub {
+ public:
+  // Tier 0 is the best; higher tiers are smaller and cheaper.
+  static const int TIER_COUNT = 4;
+
+  LiveStreamHub(FrameBus& bus, int jpegQuality);
+
+  // Encoder thread entry point.
+  void run();
+
+  // Best tier no wider than `maxWidth` pixels and no better than JPEG quality
+  // `maxQuality`, where 0 means no limit. Falls back to the smallest tier.
+  static int tierFor(int maxWidth, int maxQuality);
+
+  // Returns the newest frame encoded for `tier` if it is newer than `cursor`,
+  // otherwise nullptr. Never blocks.
+  EncodedFramePtr newestAfter(int tier, uint64_t cursor) const;
+
+  // Registers an eventfd that is written to after each published frame.
+  void addListener(int eventFd);
+
+  // Live clients watching this camera, by tier; the encoder skips tiers
+  // without clients and idles while there are none at all.
+  // gLiveStreamClientCount keeps the total across cameras.
+  void addClient(int tier) {
+    tiers_[tier].clients.fetch_add(1, std::memory_order_relaxed);
+  }
+  void removeClient(int tier) {
+    tiers_[tier].clients.fetch_sub(1, std::memory_order_relaxed);
+  }
+  void moveClient(int from, int to) {
+    addClient(to);
+    removeClient(from);
+  }
+  int clients(int tier) const {
+    return tiers_[tier].clients.load(std::memory_order_relaxed);
+  }
+  int clients() const;
+
+  // Caps the JPEG quality of every tier (the governor's setting). Takes effect
+  // from the next encoded frame; safe from any thread.
+  void setJpegQuality(int quality) {
+    jpegQuality_.store(quality, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Tier {
+    std::atomic<int> clients{0};
+    EncodedFramePtr latest;  // Accessed only via std::atomic_load/store
+    cv::Mat scaled;  // Encoder thread only; reused for the resized frame
+  };
+
+  void encode(int tier, const CapturedFrame& source);
+  void notifyListeners();
+
+  FrameBus& bus_;
+  std::atomic<int> jpegQuality_;
+  std::vector<int> encodeParams_;  // Encoder thread only
+  RecyclingPool<EncodedFrame> encoded_;  // Encoder thread only
+
+  std::array<Tier, TIER_COUNT> tiers_;
+  std::mutex listenersMutex_;
+  std::vector<int> listeners_;
+};
+
+#endif /* LIVE_STREAM_HUB */
@@ -0,0 +1,186 @@
+#include "metrics.hpp"
+
+#include <cmath>
+#include <sstream>
+
+#include "camera.hpp"
+#include "utils.hpp"
+
+void Histogram::observe(std::chrono::steady_clock::duration elapsed) {
+  uint64_t nanos = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  double seconds = nanos / 1e9;
+  size_t bucket = 0;
+  while (bucket < BOUNDS_SECONDS.size() && seconds > BOUNDS_SECONDS[bucket]) {
+    bucket++;
+  }
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  sumNanos_.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+void Histogram::render(std::ostream& out, const char* name,
+                       const char* help) const {
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " histogram\n";
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    cumulative += buckets_[i].load(std::memory_order_relaxed);
+    out << name << "_bucket{le=\"";
+    if (i < BOUNDS_SECONDS.size()) {
+      out << BOUNDS_SECONDS[i];
+    } else {
+      out << "+Inf";
+    }
+    out << "\"} " << cumulative << "\n";
+  }
+  out << name << "_sum " << sumNanos_.load(std::memory_order_relaxed) / 1e9
+      << "\n"
+      << name << "_count " << cumulative << "\n";
+}
+
+namespace {
+
+// Values are streamed as their own type: counters stay exact integers, and
+// only real numbers like seconds go through the stream's 9 digit precision.
+template <typename Value>
+void renderValue(std::ostream& out, const char* name, const char* type,
+                 const char* help, Value value) {
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n"
+      << name << " " << value << "\n";
+}
+
+// One sample per camera, labelled with its id.
+template <typename Value>
+void renderPerCamera(std::ostream& out, const char* name, const char* type,
+                     const char* help, Value value) {
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n";
+  for (const auto& camera : gCameras) {
+    out << name << "{camera=\"" << camera->id << "\"} " << value(*camera)
+        << "\n";
+  }
+}
+
+}  // namespace
+
+std::string renderMetrics() {
+  std::ostringstream out;
+  out.precision(9);
+
+  gMetrics.capture_seconds.render(out, "motion_capture_seconds",
+                                  "Time spent reading a frame.");
+  gMetrics.detect_seconds.render(out, "motion_detect_seconds",
+                                 "Time spent analysing a frame for motion.");
+  gMetrics.encode_seconds.render(out, "motion_live_encode_seconds",
+                                 "Time spent JPEG-encoding a live frame.");
+  gMetrics.send_seconds.render(out, "motion_http_send_seconds",
+                               "Time spent in a single socket send call.");
+
+  renderValue(out, "motion_frames_captured_total", "counter",
+              "Frames published to the frame bus.",
+              gMetrics.frames_captured.value());
+  renderValue(out, "motion_capture_failures_total", "counter",
+              "Reads that returned no frame.",
+              gMetrics.capture_failures.value());
+  renderValue(out, "motion_detector_frames_skipped_total", "counter",
+              "Frames the detector missed because it fell behind.",
+              gMetrics.detector_frames_skipped.value());
+  renderPerCamera(out, "motion_capture_deadlines_missed_total", "counter",
+                  "Frames a paced source skipped because it fell behind.",
+                  [](Camera& c) { return c.source->missedDeadlines(); });
+  renderPerCamera(out, "motion_frame_pool_frames", "gauge",
+                  "Capture buffers allocated, reused from frame to frame.",
+                  [](Camera& c) { return c.frames.size(); });
+  renderPerCamera(out, "motion_frame_pool_overflows_total", "counter",
+                  "Frames allocated outside the full capture pool.",
+                  [](Camera& c) { return c.frames.overflows(); });
+  renderPerCamera(out, "motion_recorder_frames_dropped_total", "counter",
+                  "Frames dropped because the recorder queue was full.",
+                  [](Camera& c) { return c.recorder.droppedFrames(); });
+  renderPerCamera(out, "motion_recorder_queue_depth", "gauge",
+                  "Frames waiting for the recorder thread.",
+                  [](Camera& c) { return c.recorder.queueDepth(); });
+  renderPerCamera(out, "motion_recorder_frames_repeated_total", "counter",
+                  "Frames repeated to keep clips at their frame rate.",
+                  [](Camera& c) { return c.recorder.duplicatedFrames(); });
+  renderPerCamera(out, "motion_recorder_frames_skipped_total", "counter",
+                  "Frames left out for arriving ahead of the clip's rate.",
+                  [](Camera& c) { return c.recorder.skippedFrames(); });
+  renderValue(out, "motion_live_frames_encoded_total", "counter",
+              "Frames encoded for live viewers.",
+              gMetrics.live_frames_encoded.value());
+  renderPerCamera(out, "motion_live_clients", "gauge",
+                  "Connected /live viewers.",
+                  [](Camera& c) { return c.live.clients(); });
+  out << "# HELP motion_live_tier_clients /live viewers by quality tier, 0 "
+         "is the best.\n"
+      << "# TYPE motion_live_tier_clients gauge\n";
+  for (const auto& camera : gCameras) {
+    for (int tier = 0; tier < LiveStreamHub::TIER_COUNT; ++tier) {
+      out << "motion_live_tier_clients{camera=\"" << camera->id
+          << "\",tier=\"" << tier << "\"} " << camera->live.clients(tier)
+          << "\n";
+    }
+  }
+  renderValue(out, "motion_live_tier_changes_total", "counter",
+              "Times a /live viewer moved to another tier.",
+              gMetrics.live_tier_changes.value());
+  renderValue(out, "motion_retention_evicted_clips_total", "counter",
+              "Clips deleted by the retention manager.",
+              gRetention.evictedClips());
+  renderValue(out, "motion_retention_reclaimed_bytes_total", "counter",
+              "Bytes freed by deleting clips.", gRetention.reclaimedBytes());
+  renderValue(out, "motion_recordings_bytes", "gauge",
+              "Size of the indexed clips at the last retention check.",
+              gRetention.usedBytes());
+  renderValue(out, "motion_recordings_free_bytes", "gauge",
+              "Free space for recordings at the last retention check.",
+              gRetention.freeBytes());
+  renderValue(out, "motion_storage_bytes_written_total", "counter",
+              "Clip bytes copied from staging to the card.",
+              gStorage.bytesWritten());
+  renderValue(out, "motion_storage_fsyncs_total", "counter",
+              "fsync() calls on recorded clips.", gStorage.fsyncs());
+  renderValue(out, "motion_storage_backlog_bytes", "gauge",
+              "Staged clip bytes not yet on the card.",
+              gStorage.backlogBytes());
+  renderValue(out, "motion_storage_slowest_write_seconds", "gauge",
+              "Slowest block write or fsync on the card so far.",
+              gStorage.slowestWriteSeconds());
+  renderPerCamera(out, "motion_export_consumers", "gauge",
+                  "Processes attached to the frame export.",
+                  [](Camera& c) { return c.exporter.consumers(); });
+  renderPerCamera(out, "motion_export_frames_total", "counter",
+                  "Frames copied into the frame export ring.",
+                  [](Camera& c) { return c.exporter.framesExported(); });
+  renderPerCamera(out, "motion_export_frames_replaced_total", "counter",
+                  "Frames superseded before the export thread copied them.",
+                  [](Camera& c) { return c.exporter.framesReplaced(); });
+  renderPerCamera(out, "motion_classified_clips_total", "counter",
+                  "Clips labelled by the background classifier.",
+                  [](Camera& c) { return c.classifier.classifiedClips(); });
+  renderPerCamera(out, "motion_classifier_paused", "gauge",
+                  "1 while the classifier waits for the CPU to be idle.",
+                  [](Camera& c) { return c.classifier.paused() ? 1 : 0; });
+  renderPerCamera(out, "motion_thumbnail_cache_hits_total", "counter",
+                  "Thumbnails served from memory.",
+                  [](Camera& c) { return c.thumbnails.hits(); });
+  renderPerCamera(out, "motion_thumbnail_cache_misses_total", "counter",
+                  "Thumbnail requests that went to disk.",
+                  [](Camera& c) { return c.thumbnails.misses(); });
+  renderValue(out, "motion_governor_level", "gauge",
+              "Governor quality level, 0 is full quality.",
+              gGovernor.level());
+  if (!std::isnan(gGovernor.temperature())) {
+    renderValue(out, "motion_cpu_temperature_celsius", "gauge",
+                "Last temperature read by the governor.",
+                gGovernor.temperature());
+  }
+  renderValue(out, "motion_http_requests_total", "counter",
+              "HTTP requests handled.", gMetrics.http_requests.value());
+  renderValue(out, "motion_http_bytes_sent_total", "counter",
+              "Bytes written to HTTP clients.",
+              gMetrics.http_bytes_sent.value());
+  return out.str();
+}
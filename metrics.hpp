@@ -0,0 +1,61 @@
+#ifndef METRICS
+#define METRICS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Monotonic event counter. Relaxed increments only: nothing is ordered by it.
+class Counter {
+ public:
+  void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// Latency histogram over a fixed set of buckets (0.5 ms .. 1 s, plus +Inf)
+// shared by every stage, so observe() is a short scan and two relaxed adds
+// with no allocation or locking. Safe to call from any thread; a concurrent
+// render() may see a sample in the buckets before it reaches the sum.
+class Histogram {
+ public:
+  static constexpr std::array<double, 11> BOUNDS_SECONDS = {
+      0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0};
+
+  void observe(std::chrono::steady_clock::duration elapsed);
+
+  // Prometheus text exposition of this histogram as `name`.
+  void render(std::ostream& out, const char* name, const char* help) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, BOUNDS_SECONDS.size() + 1> buckets_{};
+  std::atomic<uint64_t> sumNanos_{0};
+};
+
+// Hot-path instrumentation, written by the pipeline threads and only read by
+// /metrics. Gauges that already exist elsewhere (recorder queue, live client
+// count) are sampled at scrape time instead of being mirrored here.
+struct Metrics {
+  Histogram capture_seconds;  // FrameSource::read(), including the wait
+  Histogram detect_seconds;   // MotionKernel::process()
+  Histogram encode_seconds;   // Live JPEG encode in LiveStreamHub
+  Histogram send_seconds;     // sendmsg()/sendfile() calls in the HTTP workers
+
+  Counter frames_captured;
+  Counter capture_failures;
+  Counter detector_frames_skipped;  // Detector fell behind the frame bus
+  Counter live_frames_encoded;
+  Counter live_tier_changes;  // Backpressure moved a viewer up or down
+  Counter http_requests;
+  Counter http_bytes_sent;
+};
+
+// Renders gMetrics and the sampled gauges in Prometheus text format.
+std::string renderMetrics();
+
+#endif /* METRICS */
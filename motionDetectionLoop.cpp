@@ -1,172 +1,168 @@
-#include <sys/stat.h>  // For mkdir
-
+#include <algorithm>
 #include <iostream>
+#include <utility>
 #include <opencv2/opencv.hpp>
 #include <thread>
 
+#include "camera.hpp"
+#include "clipPolicy.hpp"
 #include "defines.hpp"
+#include "motionKernel.hpp"
+#include "preRollBuffer.hpp"
 #include "utils.hpp"
 
 // --- Motion Detection Loop ---
-void motionDetectionLoop() {
-  cv::Mat frame, gray, prevGray, diff;
-  bool transientMotionDetected = false;
-
-  // Ensure recordings directory exists
-  mkdir(RECORDINGS_DIR.c_str(),
-        0755);  // Read/write/execute for owner, read/execute for group/others
-
-  std::cout << "[MotionDetector] Starting motion detection loop." << std::endl;
+void motionDetectionLoop(Camera& camera) {
+  // Analysis runs on a downscaled image; gray/prevGray are swapped every frame
+  // so both buffers are reused instead of cloned.
+  MotionKernel motionKernel(ANALYSIS_SCALE, GAUSSIAN_BLUR_SIZE,
+                            static_cast<int>(THRESHOLD_VALUE));
+  TileGrid tileGrid(TILE_GRID_COLS, TILE_GRID_ROWS, TILE_MASK,
+                    TILE_PIXELS_PER_LEVEL, TILE_DEFAULT_LEVEL,
+                    MIN_ACTIVE_TILES);
+  motionKernel.setTileGrid(&tileGrid);
+  cv::Mat gray, prevGray;
+  uint64_t cursor = 0;  // Last camera.bus sequence consumed
+  VideoRecorder& recorder = camera.recorder;
+
+  // Already sanity-checked by the source, fixed once it is open
+  double actualFps = camera.source->fps();
+
+  // Compressed history of the last PREROLL_SECONDS, flushed into each clip
+  // ahead of the live frames so the start of the event is not lost.
+  PreRollBuffer preRoll(
+      PREROLL_MEMORY_BUDGET_BYTES,
+      std::chrono::milliseconds(static_cast<long long>(PREROLL_SECONDS * 1000)),
+      static_cast<size_t>(PREROLL_SECONDS * actualFps) + 1,
+      PREROLL_JPEG_QUALITY);
+  ClipPolicy clipPolicy(RECORDING_POST_MOTION_SECONDS,
+                        RECORDING_MERGE_GAP_SECONDS, RECORDING_MAX_SECONDS);
+  // Largest nonZeroCount of the clip being recorded, and the frame it was
+  // seen in (kept for the thumbnail)
+  int peakMotion = 0;
+  FramePtr peakFrame;
+
+  // The pre-roll arena is about to be overwritten by new frames, so its
+  // contents are copied out for the writer thread to decode.
+  auto takePreRoll = [&preRoll] {
+    std::vector<BufferedFrame> frames;
+    frames.reserve(preRoll.size());
+    preRoll.drain([&](const uchar* jpeg, size_t size,
+                      PreRollBuffer::Clock::time_point captureTime) {
+      frames.push_back({std::vector<uchar>(jpeg, jpeg + size), captureTime});
+    });
+    return frames;
+  };
+
+  std::cout << "[MotionDetector] Starting motion detection loop for camera "
+            << camera.id << "." << std::endl;
 
   while (true) {
-    if (gIsLiveStreamingActive.load(std::memory_order_relaxed)) {
-      if (transientMotionDetected) {
-        std::cout
-            << "[MotionDetector] Pausing motion detection for live stream."
-            << std::endl;
-        prevGray.release();  // Reset previous frame to avoid false positive
-                             // after stream
-        transientMotionDetected = false;
-      }
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(200));  // Sleep while live stream is active
+    // Frames on the bus are shared and immutable, so no clone is needed even
+    // though the capture thread keeps producing while we work.
+    uint64_t previousCursor = cursor;
+    FramePtr frame = camera.bus.waitNext(cursor, std::chrono::seconds(1));
+    if (!frame) {
+      std::cerr << "[MotionDetector] Warning: No frame from capture thread "
+                << "of camera " << camera.id << "." << std::endl;
       continue;
     }
-
-    if (!transientMotionDetected) {
-      std::cout << "[MotionDetector] Resuming motion detection." << std::endl;
-      transientMotionDetected = true;
-      // prevGray will be initialized on the next valid frame
+    if (previousCursor != 0 && frame->sequence > previousCursor + 1) {
+      gMetrics.detector_frames_skipped.add(frame->sequence - previousCursor -
+                                           1);
     }
-
-    cv::Mat currentFrame;
-    {
-      std::lock_guard<std::mutex> lock(gCameraMutex);
-      if (!gCap.isOpened()) {
-        std::cerr << "[MotionDetector] Error: Camera not accessible in loop."
-                  << std::endl;
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        continue;
+    const cv::Mat& currentFrame = frame->image;
+
+    // Detection keeps running while a clip is open, so the clip follows the
+    // motion instead of recording blind for a fixed time. The governor may
+    // thin out analysis or coarsen it under heat and load; frames that are
+    // not analysed count as still and are buffered or recorded as usual.
+    int nonZeroCount = -1;
+    bool motion = false;
+    FrameMotion frameMotion;  // For the clip's timeline
+    GovernorSettings governed = gGovernor.settings();
+    if (frame->sequence % governed.analysis_stride == 0) {
+      if (governed.analysis_scale != motionKernel.scale()) {
+        // prevGray no longer matches in size, so the next frame only primes
+        // it.
+        motionKernel = MotionKernel(governed.analysis_scale,
+                                    GAUSSIAN_BLUR_SIZE,
+                                    static_cast<int>(THRESHOLD_VALUE));
+        motionKernel.setTileGrid(&tileGrid);
       }
-      gCap >> frame;  // Grab frame
-    }
 
-    if (frame.empty()) {
-      std::cerr << "[MotionDetector] Warning: Empty frame captured."
-                << std::endl;
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(100));  // Wait a bit before retrying
-      continue;
+      // Grayscale, blur, difference, threshold and per-tile count in one
+      // fused pass; nonZeroCount is in full-resolution pixels whatever
+      // ANALYSIS_SCALE is. While idle the scan stops as soon as enough tiles
+      // are active; during a clip the full count feeds its motion score.
+      motionKernel.setEarlyExit(!clipPolicy.clipOpen());
+      auto detectStart = std::chrono::steady_clock::now();
+      nonZeroCount = motionKernel.process(currentFrame, prevGray, gray);
+      gMetrics.detect_seconds.observe(std::chrono::steady_clock::now() -
+                                      detectStart);
+      motion = nonZeroCount >= 0 && motionKernel.tileActivity().triggered;
+      frameMotion = describeMotion(nonZeroCount, motionKernel.tileActivity(),
+                                   currentFrame.size());
+      if (motion) gGovernor.notifyMotion();
+      std::swap(gray, prevGray);
     }
-
-    // It's good practice to clone the frame if it's going to be used by
-    // VideoWriter while the original `frame` might be overwritten by the next
-    // camera read.
-    currentFrame = frame.clone();
-
-    cv::cvtColor(currentFrame, gray, cv::COLOR_BGR2GRAY);
-    cv::GaussianBlur(gray, gray,
-                     cv::Size(GAUSSIAN_BLUR_SIZE, GAUSSIAN_BLUR_SIZE), 0);
-
-    if (!prevGray.empty()) {
-      cv::absdiff(prevGray, gray, diff);
-      cv::threshold(diff, diff, THRESHOLD_VALUE, 255, cv::THRESH_BINARY);
-      int nonZeroCount = cv::countNonZero(diff);
-
-      if (nonZeroCount > MIN_NON_ZERO_COUNT) {
+    // Local consumer processes get every frame, analysed or not.
+    camera.exporter.offer(frame, frameMotion);
+
+    ClipPolicy::Action action =
+        clipPolicy.update(frame->capture_time, motion);
+    switch (action) {
+      case ClipPolicy::Action::Buffer:
+        preRoll.push(currentFrame, frame->capture_time);
+        break;
+
+      case ClipPolicy::Action::Split:
+        recorder.endClip(peakMotion, std::move(peakFrame));
+        [[fallthrough]];
+      case ClipPolicy::Action::Begin: {
         auto nowChrono = std::chrono::system_clock::now();
         std::time_t nowC = std::chrono::system_clock::to_time_t(nowChrono);
-        std::tm nowTm = *std::localtime(
-            &nowC);  // Note: localtime is not thread-safe but okay here
+        std::tm nowTm{};
+        localtime_r(&nowC, &nowTm);  // Detectors of all cameras run at once
 
-        char filenameBuf[128], timestampBuf[64], prettyTimestampBuf[64];
+        char filenameBuf[128];
         std::strftime(filenameBuf, sizeof(filenameBuf),
                       "motion_%Y%m%d_%H%M%S.avi", &nowTm);
-        std::strftime(timestampBuf, sizeof(timestampBuf), "%Y-%m-%dT%H:%M:%SZ",
-                      &nowTm);  // ISO 8601 like
-        std::strftime(prettyTimestampBuf, sizeof(prettyTimestampBuf),
-                      "%Y-%m-%d %H:%M:%S", &nowTm);
-
-        std::string videoFilename = RECORDINGS_DIR + "/" + filenameBuf;
-        std::cout << "[MotionDetector] Motion detected! Recording "
-                  << videoFilename << std::endl;
-
-        cv::VideoWriter videoWriter;
-        int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
-        cv::Size frameSize(
-            static_cast<int>(gCap.get(cv::CAP_PROP_FRAME_WIDTH)),
-            static_cast<int>(gCap.get(cv::CAP_PROP_FRAME_HEIGHT)));
-
-        // Use the actual FPS from the camera if available and reasonable,
-        // otherwise fallback
-        double actualFps = gCap.get(cv::CAP_PROP_FPS);
-        if (actualFps <= 0 || actualFps > 60)
-          actualFps = CAP_FPS;  // Sanity check
-
-        videoWriter.open(videoFilename, fourcc, actualFps, frameSize, true);
-
-        if (!videoWriter.isOpened()) {
-          std::cerr << "[MotionDetector] Error: Could not open VideoWriter for "
-                    << videoFilename << std::endl;
-        } else {
-          auto recordingStartTime = std::chrono::steady_clock::now();
-          int framesWritten = 0;
-          while (std::chrono::steady_clock::now() - recordingStartTime <
-                 std::chrono::seconds(VIDEO_RECORD_DURATION_SECONDS)) {
-            cv::Mat videoFrame;
-            {  // Scope for camera lock
-              std::lock_guard<std::mutex> lock(gCameraMutex);
-              if (!gCap.isOpened() ||
-                  gIsLiveStreamingActive.load(
-                      std::memory_order_relaxed)) {  // Check live stream status
-                                                     // during recording
-                std::cout << "[MotionDetector] Live stream started during "
-                             "recording, aborting video save."
-                          << std::endl;
-                break;
-              }
-              gCap >> videoFrame;
-            }
-            if (videoFrame.empty()) break;
-            videoWriter.write(videoFrame.clone());  // Write a clone
-            framesWritten++;
-            // Small delay to roughly match desired FPS if camera is faster
-            // This is a simple way; a more precise frame timing mechanism could
-            // be used.
-            std::this_thread::sleep_for(std::chrono::milliseconds(
-                static_cast<long long>(1000.0 / actualFps / 2.0)));
-          }
-          videoWriter.release();
-          std::cout << "[MotionDetector] Finished recording " << videoFilename
-                    << ", " << framesWritten << " frames." << std::endl;
-
-          if (framesWritten > 0) {  // Only add if some frames were written
-            std::lock_guard<std::mutex> lock(gDetectionMutex);
-            gRecentDetections.push_front(
-                {filenameBuf, timestampBuf,
-                 prettyTimestampBuf});  // Store only base filename
-            if (gRecentDetections.size() > MAX_RECENT_DETECTIONS) {
-              // Optional: Delete the oldest video file from disk
-              // std::string oldFile = RECORDINGS_DIR + "/" +
-              // g_recentDetections.back().videoFilename;
-              // remove(oldFile.c_str());
-              gRecentDetections.pop_back();
-            }
-          } else if (videoWriter.isOpened()) {  // If it was opened but no
-                                                // frames, means it was aborted
-            // videoWriter.release() was called. If the file was created empty,
-            // delete it.
-            remove(videoFilename.c_str());
-            std::cout
-                << "[MotionDetector] Recording aborted, deleted empty file: "
-                << videoFilename << std::endl;
-          }
-        }
+
+        std::cout << "[MotionDetector] Camera " << camera.id
+                  << ": Motion detected in "
+                  << motionKernel.tileActivity().active_tiles
+                  << " tile(s)! Recording " << filenameBuf << std::endl;
+
+        recorder.beginClip(
+            {filenameBuf, nowChrono, actualFps, currentFrame.size()},
+            takePreRoll());
+        recorder.pushFrame(frame, frameMotion);
+        peakMotion = nonZeroCount;
+        peakFrame = frame;
+        break;
       }
+
+      case ClipPolicy::Action::Resume:
+        recorder.resumeClip(takePreRoll());
+        recorder.pushFrame(frame, frameMotion);
+        break;
+
+      case ClipPolicy::Action::Write:
+        recorder.pushFrame(frame, frameMotion);
+        break;
+
+      case ClipPolicy::Action::End:
+        recorder.endClip(peakMotion, std::move(peakFrame));
+        preRoll.push(currentFrame, frame->capture_time);
+        break;
+    }
+    bool written = action == ClipPolicy::Action::Write ||
+                   action == ClipPolicy::Action::Resume;
+    if (written && nonZeroCount > peakMotion) {
+      peakMotion = nonZeroCount;
+      peakFrame = frame;
     }
-    prevGray = gray.clone();
-    std::this_thread::sleep_for(std::chrono::milliseconds(
-        static_cast<long long>(1000.0 / CAP_FPS)));  // Control processing rate
   }
   std::cout << "[MotionDetector] Exiting motion detection loop." << std::endl;
 }
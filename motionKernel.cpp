@@ -0,0 +1,334 @@
+#include "motionKernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// BT.601 luma weights in Q14, identical to cv::cvtColor(COLOR_BGR2GRAY).
+const int GRAY_B = 1868, GRAY_G = 9617, GRAY_R = 4899, GRAY_SHIFT = 14;
+
+// Mirrors OpenCV's default BORDER_REFLECT_101: 2 1 | 0 1 2 ... n-1 | n-2.
+inline int reflect101(int i, int n) {
+  if (n == 1) return 0;
+  while (i < 0 || i >= n) i = i < 0 ? -i : 2 * n - 2 - i;
+  return i;
+}
+
+inline uchar blockLuma(int sumB, int sumG, int sumR, int area) {
+  long long luma =
+      1LL * sumB * GRAY_B + 1LL * sumG * GRAY_G + 1LL * sumR * GRAY_R;
+  long long denom = 1LL * area << GRAY_SHIFT;
+  return static_cast<uchar>((luma + denom / 2) / denom);
+}
+
+// Fixed-size variant of the block average for the common BGR cases, so the
+// compiler can unroll the inner loops.
+template <int S>
+void decimateBgrRow(const cv::Mat& frame, int y, uchar* dst, int width) {
+  const uchar* rows[S];
+  for (int dy = 0; dy < S; ++dy) rows[dy] = frame.ptr<uchar>(y * S + dy);
+  for (int x = 0; x < width; ++x) {
+    int sumB = 0, sumG = 0, sumR = 0;
+    for (int dy = 0; dy < S; ++dy) {
+      const uchar* src = rows[dy] + x * S * 3;
+      for (int dx = 0; dx < S; ++dx) {
+        sumB += src[3 * dx];
+        sumG += src[3 * dx + 1];
+        sumR += src[3 * dx + 2];
+      }
+    }
+    dst[x] = blockLuma(sumB, sumG, sumR, S * S);
+  }
+}
+
+// dst[x] = round(sum_k weights[k] * src[k][x] / 256). Used for both blur
+// passes: horizontally the taps are shifted views of one padded row,
+// vertically they are rows of the ring.
+void weightedSum(const uchar* const* src, const uchar* weights, int taps,
+                 uchar* dst, int width) {
+  int x = 0;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi16(128);
+  for (; x + 32 <= width; x += 32) {
+    __m256i lo = zero, hi = zero;
+    for (int k = 0; k < taps; ++k) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(src[k] + x));
+      __m256i w = _mm256_set1_epi16(weights[k]);
+      lo = _mm256_add_epi16(
+          lo, _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), w));
+      hi = _mm256_add_epi16(
+          hi, _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), w));
+    }
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+    // unpack/pack both work per 128-bit lane, so the byte order is restored
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(lo, hi));
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i zero128 = _mm_setzero_si128();
+  const __m128i round128 = _mm_set1_epi16(128);
+  for (; x + 16 <= width; x += 16) {
+    __m128i lo = zero128, hi = zero128;
+    for (int k = 0; k < taps; ++k) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src[k] + x));
+      __m128i w = _mm_set1_epi16(weights[k]);
+      lo = _mm_add_epi16(lo,
+                         _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero128), w));
+      hi = _mm_add_epi16(hi,
+                         _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero128), w));
+    }
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, round128), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, round128), 8);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 16 <= width; x += 16) {
+    uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+    for (int k = 0; k < taps; ++k) {
+      uint8x16_t v = vld1q_u8(src[k] + x);
+      uint8x8_t w = vdup_n_u8(weights[k]);
+      lo = vmlal_u8(lo, vget_low_u8(v), w);
+      hi = vmlal_u8(hi, vget_high_u8(v), w);
+    }
+    vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#endif
+  for (; x < width; ++x) {
+    unsigned sum = 0;
+    for (int k = 0; k < taps; ++k) sum += weights[k] * src[k][x];
+    dst[x] = static_cast<uchar>((sum + 128) >> 8);
+  }
+}
+
+// Number of x with |a[x] - b[x]| > threshold.
+int countAbsDiffAbove(const uchar* a, const uchar* b, int width,
+                      uchar threshold) {
+  int count = 0, x = 0;
+#if defined(__AVX2__)
+  const __m256i thr = _mm256_set1_epi8(static_cast<char>(threshold));
+  const __m256i zero = _mm256_setzero_si256();
+  for (; x + 32 <= width; x += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+    __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb),
+                                   _mm256_subs_epu8(vb, va));
+    __m256i notAbove = _mm256_cmpeq_epi8(_mm256_subs_epu8(diff, thr), zero);
+    count += 32 - __builtin_popcount(
+                      static_cast<unsigned>(_mm256_movemask_epi8(notAbove)));
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i thr128 = _mm_set1_epi8(static_cast<char>(threshold));
+  const __m128i zero128 = _mm_setzero_si128();
+  for (; x + 16 <= width; x += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+    __m128i notAbove = _mm_cmpeq_epi8(_mm_subs_epu8(diff, thr128), zero128);
+    count += 16 - __builtin_popcount(
+                      static_cast<unsigned>(_mm_movemask_epi8(notAbove)));
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t thr = vdupq_n_u8(threshold);
+  uint16x8_t acc = vdupq_n_u16(0);
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t diff = vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x));
+    acc = vpadalq_u8(acc, vshrq_n_u8(vcgtq_u8(diff, thr), 7));
+  }
+  uint64x2_t total = vpaddlq_u32(vpaddlq_u16(acc));
+  count += static_cast<int>(vgetq_lane_u64(total, 0) +
+                            vgetq_lane_u64(total, 1));
+#endif
+  for (; x < width; ++x) {
+    if (std::abs(a[x] - b[x]) > threshold) count++;
+  }
+  return count;
+}
+
+}  // namespace
+
+MotionKernel::MotionKernel(int scale, int blurSize, int threshold)
+    : scale_(std::max(1, scale)), threshold_(threshold) {
+  // Same sigma cv::GaussianBlur derives from the kernel size, shrunk along
+  // with the image so the blur covers the same part of the scene.
+  double sigma = (0.3 * ((blurSize - 1) * 0.5 - 1) + 0.8) / scale_;
+  int size = std::max(1, (blurSize / scale_) | 1);
+  radius_ = size / 2;
+
+  std::vector<double> gauss(size);
+  double total = 0;
+  for (int i = 0; i < size; ++i) {
+    gauss[i] = std::exp(-(i - radius_) * (i - radius_) / (2 * sigma * sigma));
+    total += gauss[i];
+  }
+  // Quantise to weights summing to exactly 256; rounding error goes to the
+  // centre tap.
+  weights_.resize(size);
+  int assigned = 0;
+  for (int i = 0; i < size; ++i) {
+    weights_[i] = static_cast<uchar>(std::lround(gauss[i] / total * 256));
+    assigned += weights_[i];
+  }
+  if (size == 1) {
+    // No blur. 256 does not fit in a byte, so use two half-weight taps that
+    // both point at the same pixel (see the std::min in process()).
+    weights_ = {128, 128};
+  } else {
+    weights_[radius_] =
+        static_cast<uchar>(weights_[radius_] + 256 - assigned);
+  }
+}
+
+void MotionKernel::decimateRow(const cv::Mat& frame, int y, uchar* dst,
+                               int width) const {
+  const int s = scale_;
+  const int channels = frame.channels();
+  if (s == 1) {
+    const uchar* src = frame.ptr<uchar>(y);
+    if (channels == 1) {
+      std::copy(src, src + width, dst);
+      return;
+    }
+    for (int x = 0; x < width; ++x, src += channels) {
+      dst[x] = static_cast<uchar>(
+          (src[0] * GRAY_B + src[1] * GRAY_G + src[2] * GRAY_R +
+           (1 << (GRAY_SHIFT - 1))) >>
+          GRAY_SHIFT);
+    }
+    return;
+  }
+
+  if (channels == 3 && s == 2) {
+    return decimateBgrRow<2>(frame, y, dst, width);
+  }
+  if (channels == 3 && s == 4) {
+    return decimateBgrRow<4>(frame, y, dst, width);
+  }
+
+  // Average each s x s block; luma is linear, so converting the channel sums
+  // is the same as averaging converted pixels.
+  const int area = s * s;
+  for (int x = 0; x < width; ++x) {
+    int sumB = 0, sumG = 0, sumR = 0;
+    for (int dy = 0; dy < s; ++dy) {
+      const uchar* src = frame.ptr<uchar>(y * s + dy) + x * s * channels;
+      for (int dx = 0; dx < s; ++dx, src += channels) {
+        sumB += src[0];
+        if (channels >= 3) {
+          sumG += src[1];
+          sumR += src[2];
+        }
+      }
+    }
+    if (channels == 1) {
+      dst[x] = static_cast<uchar>((sumB + area / 2) / area);
+    } else {
+      dst[x] = blockLuma(sumB, sumG, sumR, area);
+    }
+  }
+}
+
+int MotionKernel::process(const cv::Mat& frame, const cv::Mat& prevGray,
+                          cv::Mat& gray) {
+  const int height = frame.rows / scale_;
+  const int width = frame.cols / scale_;
+  const int taps = 2 * radius_ + 1;
+  const int weightCount = static_cast<int>(weights_.size());
+  gray.create(height, width, CV_8UC1);
+  if (height == 0 || width == 0) return -1;
+
+  const bool compare = !prevGray.empty() && prevGray.rows == height &&
+                       prevGray.cols == width && prevGray.data != gray.data;
+
+  paddedRow_.resize(width + 2 * radius_);
+  ring_.resize(static_cast<size_t>(taps) * width);
+  taps_.resize(weightCount);
+
+  auto ringRow = [&](int row) { return ring_.data() + (row % taps) * width; };
+
+  if (grid_) {
+    activity_.cols = grid_->cols();
+    activity_.rows = grid_->rows();
+    activity_.changed.assign(grid_->size(), 0);
+    activity_.active.assign(grid_->size(), 0);
+    activity_.active_tiles = 0;
+    activity_.triggered = false;
+    activity_.stopped_early = false;
+  }
+
+  int changed = 0;
+  bool comparing = compare;
+  // Row y enters the ring while row y - radius_ leaves as finished output.
+  for (int y = 0; y < height + radius_; ++y) {
+    if (y < height) {
+      uchar* row = paddedRow_.data() + radius_;
+      decimateRow(frame, y, row, width);
+      for (int i = 1; i <= radius_; ++i) {
+        row[-i] = row[reflect101(-i, width)];
+        row[width - 1 + i] = row[reflect101(width - 1 + i, width)];
+      }
+      for (int k = 0; k < weightCount; ++k) {
+        taps_[k] = paddedRow_.data() + std::min(k, taps - 1);
+      }
+      weightedSum(taps_.data(), weights_.data(), weightCount, ringRow(y),
+                  width);
+    }
+
+    int outY = y - radius_;
+    if (outY < 0) continue;
+    for (int k = 0; k < weightCount; ++k) {
+      taps_[k] = ringRow(
+          reflect101(outY - radius_ + std::min(k, taps - 1), height));
+    }
+    uchar* out = gray.ptr<uchar>(outY);
+    weightedSum(taps_.data(), weights_.data(), weightCount, out, width);
+    if (comparing) {
+      changed += compareRow(out, prevGray.ptr<uchar>(outY), outY, width,
+                            height);
+      if (activity_.stopped_early) comparing = false;
+    }
+  }
+  return compare ? changed * scale_ * scale_ : -1;
+}
+
+int MotionKernel::compareRow(const uchar* out, const uchar* prev, int y,
+                             int width, int height) {
+  const uchar threshold = static_cast<uchar>(threshold_);
+  if (!grid_) return countAbsDiffAbove(out, prev, width, threshold);
+
+  const int cols = grid_->cols();
+  const int tileRow = y * grid_->rows() / height;
+  int changed = 0;
+  for (int tileCol = 0; tileCol < cols; ++tileCol) {
+    int tile = tileRow * cols + tileCol;
+    if (!grid_->included(tile)) continue;
+    if (earlyExit_ && activity_.active[tile]) continue;  // Already decided
+
+    int x0 = tileCol * width / cols, x1 = (tileCol + 1) * width / cols;
+    int n = countAbsDiffAbove(out + x0, prev + x0, x1 - x0, threshold);
+    changed += n;
+    activity_.changed[tile] += n * scale_ * scale_;
+    if (!activity_.active[tile] &&
+        activity_.changed[tile] >= grid_->threshold(tile)) {
+      activity_.active[tile] = 1;
+      activity_.active_tiles++;
+      if (activity_.active_tiles >= grid_->minActiveTiles()) {
+        activity_.triggered = true;
+        if (earlyExit_) {
+          activity_.stopped_early = true;
+          break;
+        }
+      }
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,62 @@
+#ifndef MOTION_KERNEL
+#define MOTION_KERNEL
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "tileGrid.hpp"
+
+// Fused replacement for the cvtColor -> GaussianBlur -> absdiff -> threshold
+// -> countNonZero chain. The frame is walked once, row by row: each row is
+// area-decimated to grayscale, blurred horizontally into a small ring of rows,
+// blurred vertically once enough rows are buffered, and immediately compared
+// against the previous frame. Only the ring (a few rows) and the output image
+// are touched besides the source frame, so the working set stays in cache.
+// Blur and compare run with SSE2/AVX2 or NEON when available.
+class MotionKernel {
+ public:
+  // `scale` is the decimation factor per axis (1, 2, 4, ...). `blurSize` and
+  // `threshold` have the same meaning as for the full-resolution OpenCV path;
+  // the blur is shrunk to match the analysis resolution.
+  MotionKernel(int scale, int blurSize, int threshold);
+
+  // Writes the blurred, downscaled grayscale version of `frame` (8-bit BGR or
+  // gray) into `gray`. If `prevGray` is a previous output of the same size,
+  // returns the number of pixels whose difference exceeds the threshold,
+  // scaled back to full-resolution pixel units. Returns -1 when there is
+  // nothing to compare against. `gray` must not share its buffer with
+  // `prevGray`.
+  //
+  // With a tile grid set, changes are counted per tile as rows complete and
+  // excluded tiles are not compared at all. With early exit enabled, tiles
+  // stop being counted once active and comparison stops altogether when
+  // enough tiles are active (the blurred image is always completed, since it
+  // is the next frame's reference); the returned count is then partial.
+  int process(const cv::Mat& frame, const cv::Mat& prevGray, cv::Mat& gray);
+
+  // `grid` must outlive the kernel; nullptr compares the whole image.
+  void setTileGrid(const TileGrid* grid) { grid_ = grid; }
+  void setEarlyExit(bool enabled) { earlyExit_ = enabled; }
+  const TileActivity& tileActivity() const { return activity_; }
+
+  int scale() const { return scale_; }
+
+ private:
+  void decimateRow(const cv::Mat& frame, int y, uchar* dst, int width) const;
+  int compareRow(const uchar* out, const uchar* prev, int y, int width,
+                 int height);
+
+  int scale_;
+  int radius_;
+  int threshold_;
+  std::vector<uchar> weights_;  // 2 * radius_ + 1 taps summing to 256
+  std::vector<uchar> paddedRow_;
+  std::vector<uchar> ring_;  // 2 * radius_ + 1 horizontally blurred rows
+  std::vector<const uchar*> taps_;
+
+  const TileGrid* grid_ = nullptr;
+  bool earlyExit_ = false;
+  TileActivity activity_;
+};
+
+#endif /* MOTION_KERNEL */
@@ -0,0 +1,172 @@
+#include "motionTimeline.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+struct TimelineHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t sample_size;
+};
+
+const char TIMELINE_MAGIC[8] = {'M', 'D', 'T', 'L', 'I', 'N', 'E', '\0'};
+const uint32_t TIMELINE_VERSION = 1;
+const size_t TIMELINE_BATCH = 64;  // Samples per write(), 1 KiB
+
+static_assert(sizeof(TimelineHeader) == 16, "Timeline header layout");
+static_assert(sizeof(TimelineSample) == 16, "Timeline sample layout");
+
+bool writeAll(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+uint16_t clampToU16(int value) {
+  return static_cast<uint16_t>(std::min(std::max(value, 0), 0xFFFF));
+}
+
+}  // namespace
+
+FrameMotion describeMotion(int changedPixels, const TileActivity& activity,
+                           cv::Size frameSize) {
+  FrameMotion motion;
+  motion.changed_pixels = changedPixels;
+  if (changedPixels < 0 || activity.cols <= 0 || activity.rows <= 0) {
+    return motion;
+  }
+  int minCol = activity.cols, minRow = activity.rows, maxCol = -1, maxRow = -1;
+  for (int row = 0; row < activity.rows; ++row) {
+    for (int col = 0; col < activity.cols; ++col) {
+      if (!activity.active[row * activity.cols + col]) continue;
+      minCol = std::min(minCol, col);
+      maxCol = std::max(maxCol, col);
+      minRow = std::min(minRow, row);
+      maxRow = std::max(maxRow, row);
+    }
+  }
+  if (maxCol < 0) return motion;
+  // Same tile edges as the kernel: tile i spans [i * size / n,
+  // (i + 1) * size / n)
+  int x0 = minCol * frameSize.width / activity.cols;
+  int x1 = (maxCol + 1) * frameSize.width / activity.cols;
+  int y0 = minRow * frameSize.height / activity.rows;
+  int y1 = (maxRow + 1) * frameSize.height / activity.rows;
+  motion.bounds = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+  return motion;
+}
+
+std::string timelineNameFor(const std::string& clipName) {
+  return clipName.substr(0, clipName.find_last_of('.')) + ".timeline";
+}
+
+bool TimelineWriter::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(),
+               O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    perror(("[Timeline] Failed to create " + path).c_str());
+    return false;
+  }
+  TimelineHeader header{};
+  std::memcpy(header.magic, TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC));
+  header.version = TIMELINE_VERSION;
+  header.sample_size = sizeof(TimelineSample);
+  if (!writeAll(fd_, &header, sizeof(header))) {
+    perror("[Timeline] Failed to write header");
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  started_ = false;
+  pending_.clear();
+  pending_.reserve(TIMELINE_BATCH);
+  bytes_ = sizeof(header);
+  return true;
+}
+
+void TimelineWriter::append(std::chrono::steady_clock::time_point captureTime,
+                            const FrameMotion& motion) {
+  if (fd_ < 0) return;
+  if (!started_) {
+    start_ = captureTime;
+    started_ = true;
+  }
+  TimelineSample sample;
+  auto offset = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    captureTime - start_)
+                    .count();
+  sample.offset_ms = static_cast<uint32_t>(std::max<int64_t>(offset, 0));
+  sample.motion = motion.changed_pixels;
+  sample.x = clampToU16(motion.bounds.x);
+  sample.y = clampToU16(motion.bounds.y);
+  sample.width = clampToU16(motion.bounds.width);
+  sample.height = clampToU16(motion.bounds.height);
+  pending_.push_back(sample);
+  if (pending_.size() >= TIMELINE_BATCH) flush();
+}
+
+void TimelineWriter::flush() {
+  if (pending_.empty()) return;
+  size_t size = pending_.size() * sizeof(TimelineSample);
+  if (writeAll(fd_, pending_.data(), size)) {
+    bytes_ += size;
+  } else {
+    perror("[Timeline] Write failed");
+  }
+  pending_.clear();
+}
+
+uint64_t TimelineWriter::close() {
+  if (fd_ < 0) return 0;
+  flush();
+  ::close(fd_);
+  fd_ = -1;
+  return bytes_;
+}
+
+bool readTimeline(const std::string& path,
+                  std::vector<TimelineSample>& samples) {
+  samples.clear();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st {};
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+
+  TimelineHeader header{};
+  bool valid = pread(fd, &header, sizeof(header), 0) ==
+                   static_cast<ssize_t>(sizeof(header)) &&
+               std::memcmp(header.magic, TIMELINE_MAGIC,
+                           sizeof(TIMELINE_MAGIC)) == 0 &&
+               header.version == TIMELINE_VERSION &&
+               header.sample_size == sizeof(TimelineSample);
+  if (valid) {
+    // A torn last record (crash mid-write) is left out.
+    samples.resize((static_cast<size_t>(st.st_size) - sizeof(header)) /
+                   sizeof(TimelineSample));
+    size_t size = samples.size() * sizeof(TimelineSample);
+    valid = pread(fd, samples.data(), size, sizeof(header)) ==
+            static_cast<ssize_t>(size);
+  }
+  ::close(fd);
+  if (!valid) samples.clear();
+  return valid;
+}
@@ -0,0 +1,69 @@
+#ifndef MOTION_TIMELINE
+#define MOTION_TIMELINE
+
+#include <chrono>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "tileGrid.hpp"
+
+// What the detector saw in one frame, handed to the recorder along with it.
+struct FrameMotion {
+  int changed_pixels = -1;  // Full-resolution units, -1 if not analysed
+  cv::Rect bounds;          // Union of the active tiles, empty if none
+};
+
+// Summarizes the kernel's result for a frame of `frameSize`.
+FrameMotion describeMotion(int changedPixels, const TileActivity& activity,
+                           cv::Size frameSize);
+
+// One record of a clip's timeline sidecar (<clip stem>.timeline): a 16 byte
+// header followed by one of these per frame in the order the frames were
+// written, so record N describes frame N of the clip. Tools can find the
+// busy seconds of a clip, or rank clips, without decoding any video.
+struct TimelineSample {
+  uint32_t offset_ms = 0;  // Capture time relative to the clip's first frame
+  int32_t motion = -1;     // FrameMotion::changed_pixels
+  uint16_t x = 0;          // FrameMotion::bounds
+  uint16_t y = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+};
+
+// "motion_X.avi" -> "motion_X.timeline"
+std::string timelineNameFor(const std::string& clipName);
+
+// Streams a sidecar to disk while a clip is recorded. Samples are collected
+// in a small buffer and appended with one write() per batch, so the per-frame
+// cost is a 16 byte copy. A crash leaves at most a torn last record, which
+// readTimeline() ignores.
+class TimelineWriter {
+ public:
+  TimelineWriter() = default;
+  ~TimelineWriter() { close(); }
+  TimelineWriter(const TimelineWriter&) = delete;
+  TimelineWriter& operator=(const TimelineWriter&) = delete;
+
+  bool open(const std::string& path);
+  void append(std::chrono::steady_clock::time_point captureTime,
+              const FrameMotion& motion);
+  // Flushes and closes the file. Returns its size, 0 if none was open.
+  uint64_t close();
+
+ private:
+  void flush();
+
+  int fd_ = -1;
+  bool started_ = false;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<TimelineSample> pending_;
+  uint64_t bytes_ = 0;
+};
+
+// Loads a sidecar. Returns false if it is missing or not a timeline.
+bool readTimeline(const std::string& path,
+                  std::vector<TimelineSample>& samples);
+
+#endif /* MOTION_TIMELINE */
@@ -0,0 +1,589 @@
+// End-to-end pipeline benchmark. Drives the detector's per-frame work
+// (capture/decode, fused motion analysis, pre-roll encode, live JPEG encode
+// and clip writing) from synthetic or recorded input as fast as it will go,
+// for every combination of the configured resolutions and tuning values.
+//
+// Usage: motion_bench [options]
+//   --source=synthetic|file:PATH  input (default synthetic; a file is replayed
+//                                 at its own resolution; PATH may not contain
+//                                 ',' or '"')
+//   --resolutions=WxH[,WxH...]    synthetic frame sizes (default CAP_WIDTH x
+//                                 CAP_HEIGHT)
+//   --scales=N[,N...]             analysis scales (default ANALYSIS_SCALE)
+//   --blur=N[,N...]               blur sizes (default GAUSSIAN_BLUR_SIZE)
+//   --quality=N[,N...]            live JPEG qualities (default
+//                                 LIVE_JPEG_QUALITY)
+//   --frames=N                    measured frames per config (default 300)
+//   --warmup=N                    unmeasured frames per config (default 10)
+//   --format=json|csv             output format (default json)
+//   --out=PATH                    write results there instead of stdout
+//   --record-dir=DIR              scratch directory for clips (default /tmp)
+//   --baseline=PATH.csv           compare with a previous --format=csv run
+//   --tolerance=PCT               allowed regression in fps and p99 before
+//                                 the comparison fails (default 10)
+//   --check-allocations           fail if the warmed-up per-frame path
+//                                 allocates (see below)
+//
+// Stages are timed inline on one thread, so each number is the cost of that
+// stage alone rather than an end-to-end latency through the real queues.
+// Recording follows the detector through the same ClipPolicy: motion opens a
+// clip (pre-roll is decoded into it) that is extended while motion lasts, in
+// input time. The synthetic scene moves during the middle third of the run.
+// Frames come from a RecyclingPool, as in captureLoop.
+//
+// Heap allocations are counted per stage (allocationCounter.hpp) over the
+// measured frames that buffer or write, leaving out clip starts and ends,
+// which open files. --check-allocations requires that no cv::Mat buffer is
+// allocated in any stage and nothing at all in capture and detection. The
+// JPEG stages (pre-roll, encode, record) are reported but not held to zero:
+// OpenCV creates a small encoder object on every call.
+//
+// Exit status is 2 when a baseline comparison finds a regression and 3 when
+// the allocation check fails.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "allocationCounter.hpp"
+#include "clipPolicy.hpp"
+#include "defines.hpp"
+#include "frameBus.hpp"
+#include "frameSource.hpp"
+#include "motionKernel.hpp"
+#include "preRollBuffer.hpp"
+#include "recyclingPool.hpp"
+#include "tileGrid.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Stage { CAPTURE, DETECT, PREROLL, ENCODE, RECORD, STAGE_COUNT };
+const char* const STAGE_NAMES[STAGE_COUNT] = {"capture", "detect", "preroll",
+                                              "encode", "record"};
+
+struct BenchConfig {
+  std::string source;
+  cv::Size size;
+  int scale;
+  int blur;
+  int quality;
+
+  std::string key() const {
+    std::ostringstream out;
+    out << source << "/" << size.width << "x" << size.height << "/s" << scale
+        << "/b" << blur << "/q" << quality;
+    return out.str();
+  }
+};
+
+struct BenchResult {
+  BenchConfig config;
+  int frames = 0;
+  double fps = 0;
+  double cpu_seconds = 0;
+  double cpu_percent = 0;
+  long peak_rss_kb = 0;
+  int clips = 0;
+  int recorded_frames = 0;
+  double p50_ms[STAGE_COUNT] = {};
+  double p99_ms[STAGE_COUNT] = {};
+  // Over the measured frames that neither start nor end a clip
+  int steady_frames = 0;
+  double allocs_per_frame[STAGE_COUNT] = {};
+  double mat_allocs_per_frame = 0;
+};
+
+std::vector<std::string> splitList(const std::string& list) {
+  std::vector<std::string> items;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+std::vector<int> parseInts(const std::string& list) {
+  std::vector<int> values;
+  for (const auto& item : splitList(list)) {
+    values.push_back(std::atoi(item.c_str()));
+  }
+  return values;
+}
+
+double percentile(std::vector<double>& samples, double fraction) {
+  if (samples.empty()) return 0;
+  size_t index = static_cast<size_t>(fraction * (samples.size() - 1) + 0.5);
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+double cpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Peak RSS is a process-wide high-water mark; writing "5" to clear_refs
+// (Linux 4.0+) resets it so each config gets its own figure.
+void resetPeakRss() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs) clearRefs << "5";
+}
+
+long peakRssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) return std::atol(line.c_str() + 6);
+  }
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;  // Fallback: never reset, so monotonic across runs
+}
+
+std::unique_ptr<FrameSource> openSource(const BenchConfig& config,
+                                        int totalFrames) {
+  std::unique_ptr<FrameSource> source;
+  if (config.source == "synthetic") {
+    double seconds = totalFrames / CAP_FPS;
+    source.reset(new SyntheticSource(config.size, CAP_FPS,
+                                     {{seconds / 3, 2 * seconds / 3}}, false));
+  } else {
+    source = createFrameSource(config.source, false);
+  }
+  if (!source || !source->open()) return nullptr;
+  return source;
+}
+
+bool runConfig(const BenchConfig& config, int frames, int warmup,
+               const std::string& recordDir, BenchResult& result) {
+  std::unique_ptr<FrameSource> source = openSource(config, warmup + frames);
+  if (!source) {
+    std::cerr << "[Bench] Error: Could not open source " << config.source
+              << std::endl;
+    return false;
+  }
+  double fps = source->fps();
+
+  MotionKernel kernel(config.scale, config.blur,
+                      static_cast<int>(THRESHOLD_VALUE));
+  TileGrid grid(TILE_GRID_COLS, TILE_GRID_ROWS, TILE_MASK,
+                TILE_PIXELS_PER_LEVEL, TILE_DEFAULT_LEVEL, MIN_ACTIVE_TILES);
+  kernel.setTileGrid(&grid);
+  PreRollBuffer preRoll(
+      PREROLL_MEMORY_BUDGET_BYTES,
+      std::chrono::milliseconds(static_cast<long long>(PREROLL_SECONDS * 1000)),
+      static_cast<size_t>(PREROLL_SECONDS * fps) + 1, PREROLL_JPEG_QUALITY);
+  std::vector<int> encodeParams = {cv::IMWRITE_JPEG_QUALITY, config.quality};
+  std::vector<uchar> liveJpeg;
+  cv::VideoWriter writer;
+  cv::Mat decoded, gray, prevGray;
+  RecyclingPool<CapturedFrame> framePool(FRAME_POOL_MAX_FRAMES);
+  framePool.preallocate(FRAME_POOL_FRAMES, [&](CapturedFrame& frame) {
+    frame.image.create(source->frameSize(), CV_8UC3);
+  });
+  std::string clipPath;
+
+  std::vector<double> samples[STAGE_COUNT];
+  for (auto& stage : samples) stage.reserve(frames);
+
+  // Input time advances by 1/fps per frame whatever the real speed, so the
+  // pre-roll window and clip length behave as they would on a camera.
+  const Clock::time_point inputStart = Clock::now();
+  ClipPolicy clipPolicy(RECORDING_POST_MOTION_SECONDS,
+                        RECORDING_MERGE_GAP_SECONDS, RECORDING_MAX_SECONDS);
+
+  uint64_t stageAllocTotals[STAGE_COUNT] = {};
+  uint64_t matAllocTotal = 0;
+
+  resetPeakRss();
+  double cpuStart = 0;
+  Clock::time_point wallStart;
+
+  for (int i = 0; i < warmup + frames; ++i) {
+    if (i == warmup) {
+      cpuStart = cpuSeconds();
+      wallStart = Clock::now();
+    }
+    bool measured = i >= warmup;
+    Clock::time_point inputTime =
+        inputStart + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(i / fps));
+    double stageMs[STAGE_COUNT] = {};
+    uint64_t stageAllocs[STAGE_COUNT] = {};
+    uint64_t matAllocs = 0;
+    auto lap = Clock::now();
+    AllocationCount lapCount = allocationCount();
+    auto stop = [&](Stage stage) {
+      auto now = Clock::now();
+      AllocationCount count = allocationCount();
+      stageMs[stage] +=
+          std::chrono::duration<double, std::milli>(now - lap).count();
+      stageAllocs[stage] += count.heap - lapCount.heap;
+      matAllocs += count.mat_buffers - lapCount.mat_buffers;
+      lap = now;
+      lapCount = count;
+    };
+
+    std::shared_ptr<CapturedFrame> captured = framePool.acquire();
+    cv::Mat& frame = captured->image;
+    if (!source->read(frame) || frame.empty()) {
+      std::cerr << "[Bench] Error: Source ran dry at frame " << i << std::endl;
+      return false;
+    }
+    stop(CAPTURE);
+
+    kernel.setEarlyExit(!clipPolicy.clipOpen());
+    int changed = kernel.process(frame, prevGray, gray);
+    bool motion = changed >= 0 && kernel.tileActivity().triggered;
+    stop(DETECT);
+
+    cv::imencode(".jpg", frame, liveJpeg, encodeParams);
+    stop(ENCODE);
+
+    ClipPolicy::Action action = clipPolicy.update(inputTime, motion);
+    if (action == ClipPolicy::Action::End ||
+        action == ClipPolicy::Action::Split) {
+      writer.release();
+      std::remove(clipPath.c_str());
+      lap = Clock::now();  // Closing a clip belongs to neither stage
+      lapCount = allocationCount();
+    }
+    switch (action) {
+      case ClipPolicy::Action::Buffer:
+      case ClipPolicy::Action::End:
+        preRoll.push(frame, inputTime);
+        stop(PREROLL);
+        break;
+      case ClipPolicy::Action::Begin:
+      case ClipPolicy::Action::Split:
+        clipPath = recordDir + "/motion_bench_clip.avi";
+        writer.open(clipPath, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                    fps, frame.size(), true);
+        if (measured) result.clips++;
+        [[fallthrough]];
+      case ClipPolicy::Action::Resume:
+        preRoll.drain([&](const uchar* jpeg, size_t size, Clock::time_point) {
+          cv::imdecode(cv::Mat(1, static_cast<int>(size), CV_8UC1,
+                               const_cast<uchar*>(jpeg)),
+                       cv::IMREAD_COLOR, &decoded);
+          if (!decoded.empty()) writer.write(decoded);
+          if (measured) result.recorded_frames++;
+        });
+        [[fallthrough]];
+      case ClipPolicy::Action::Write:
+        writer.write(frame);
+        if (measured) result.recorded_frames++;
+        stop(RECORD);
+        break;
+    }
+    std::swap(gray, prevGray);
+
+    if (measured) {
+      for (int s = 0; s < STAGE_COUNT; ++s) samples[s].push_back(stageMs[s]);
+    }
+    bool steady = action == ClipPolicy::Action::Buffer ||
+                  action == ClipPolicy::Action::Write;
+    if (measured && steady) {
+      result.steady_frames++;
+      for (int s = 0; s < STAGE_COUNT; ++s) {
+        stageAllocTotals[s] += stageAllocs[s];
+      }
+      matAllocTotal += matAllocs;
+    }
+  }
+  if (writer.isOpened()) {
+    writer.release();
+    std::remove(clipPath.c_str());
+  }
+
+  double wallSeconds =
+      std::chrono::duration<double>(Clock::now() - wallStart).count();
+  result.config = config;
+  result.config.size = source->frameSize();
+  result.frames = frames;
+  result.fps = wallSeconds > 0 ? frames / wallSeconds : 0;
+  result.cpu_seconds = cpuSeconds() - cpuStart;
+  result.cpu_percent =
+      wallSeconds > 0 ? 100.0 * result.cpu_seconds / wallSeconds : 0;
+  result.peak_rss_kb = peakRssKb();
+  for (int s = 0; s < STAGE_COUNT; ++s) {
+    result.p50_ms[s] = percentile(samples[s], 0.50);
+    result.p99_ms[s] = percentile(samples[s], 0.99);
+  }
+  if (result.steady_frames > 0) {
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      result.allocs_per_frame[s] =
+          static_cast<double>(stageAllocTotals[s]) / result.steady_frames;
+    }
+    result.mat_allocs_per_frame =
+        static_cast<double>(matAllocTotal) / result.steady_frames;
+  }
+  return true;
+}
+
+// --- Output ---
+
+const char* const CSV_FIXED_COLUMNS =
+    "config,source,width,height,scale,blur,quality,frames,fps,cpu_seconds,"
+    "cpu_percent,peak_rss_kb,clips,recorded_frames,steady_frames,"
+    "mat_allocs_per_frame";
+
+void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+  out << CSV_FIXED_COLUMNS;
+  for (const char* stage : STAGE_NAMES) {
+    out << "," << stage << "_p50_ms," << stage << "_p99_ms," << stage
+        << "_allocs_per_frame";
+  }
+  out << "\n";
+  for (const auto& r : results) {
+    out << r.config.key() << "," << r.config.source << ","
+        << r.config.size.width << "," << r.config.size.height << ","
+        << r.config.scale << "," << r.config.blur << "," << r.config.quality
+        << "," << r.frames << "," << r.fps << "," << r.cpu_seconds << ","
+        << r.cpu_percent << "," << r.peak_rss_kb << "," << r.clips << ","
+        << r.recorded_frames << "," << r.steady_frames << ","
+        << r.mat_allocs_per_frame;
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      out << "," << r.p50_ms[s] << "," << r.p99_ms[s] << ","
+          << r.allocs_per_frame[s];
+    }
+    out << "\n";
+  }
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results) {
+  out << "{\"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    out << "  {\"config\": \"" << r.config.key() << "\", \"source\": \""
+        << r.config.source << "\", \"width\": " << r.config.size.width
+        << ", \"height\": " << r.config.size.height
+        << ", \"scale\": " << r.config.scale
+        << ", \"blur\": " << r.config.blur
+        << ", \"quality\": " << r.config.quality
+        << ", \"frames\": " << r.frames << ", \"fps\": " << r.fps
+        << ", \"cpu_seconds\": " << r.cpu_seconds
+        << ", \"cpu_percent\": " << r.cpu_percent
+        << ", \"peak_rss_kb\": " << r.peak_rss_kb
+        << ", \"clips\": " << r.clips
+        << ", \"recorded_frames\": " << r.recorded_frames
+        << ", \"steady_frames\": " << r.steady_frames
+        << ", \"mat_allocs_per_frame\": " << r.mat_allocs_per_frame
+        << ", \"stages\": {";
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      out << (s ? ", " : "") << "\"" << STAGE_NAMES[s]
+          << "\": {\"p50_ms\": " << r.p50_ms[s]
+          << ", \"p99_ms\": " << r.p99_ms[s]
+          << ", \"allocs_per_frame\": " << r.allocs_per_frame[s] << "}";
+    }
+    out << "}}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "]}\n";
+}
+
+// --- Baseline comparison ---
+
+// Reads a --format=csv file into config key -> column name -> value.
+std::map<std::string, std::map<std::string, double>> readBaseline(
+    const std::string& path) {
+  std::map<std::string, std::map<std::string, double>> rows;
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line)) return rows;
+  std::vector<std::string> columns = splitList(line);
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields = splitList(line);
+    if (fields.size() != columns.size()) continue;
+    auto& row = rows[fields[0]];
+    for (size_t c = 1; c < columns.size(); ++c) {
+      row[columns[c]] = std::atof(fields[c].c_str());
+    }
+  }
+  return rows;
+}
+
+// Prints one line per metric and returns true if anything regressed by more
+// than `tolerancePercent`. Higher fps is better; lower p99 is better.
+bool compareWithBaseline(const std::vector<BenchResult>& results,
+                         const std::string& path, double tolerancePercent) {
+  auto baseline = readBaseline(path);
+  if (baseline.empty()) {
+    std::cerr << "[Bench] Error: No baseline rows in " << path << std::endl;
+    return true;
+  }
+
+  bool regressed = false;
+  auto report = [&](const std::string& key, const std::string& metric,
+                    double before, double after, bool higherIsBetter) {
+    if (before <= 0) return;
+    double change = 100.0 * (after - before) / before;
+    bool worse = higherIsBetter ? change < -tolerancePercent
+                                : change > tolerancePercent;
+    regressed = regressed || worse;
+    std::cerr << (worse ? "REGRESSION " : "           ") << key << " "
+              << metric << ": " << before << " -> " << after << " ("
+              << (change >= 0 ? "+" : "") << change << "%)" << std::endl;
+  };
+
+  for (const auto& r : results) {
+    auto row = baseline.find(r.config.key());
+    if (row == baseline.end()) {
+      std::cerr << "           " << r.config.key() << ": not in baseline"
+                << std::endl;
+      continue;
+    }
+    report(r.config.key(), "fps", row->second["fps"], r.fps, true);
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      std::string column = std::string(STAGE_NAMES[s]) + "_p99_ms";
+      report(r.config.key(), column, row->second[column], r.p99_ms[s], false);
+    }
+  }
+  return regressed;
+}
+
+// Prints every config that allocated where it must not and returns true if
+// there was one.
+bool checkAllocations(const std::vector<BenchResult>& results) {
+  bool failed = false;
+  for (const auto& r : results) {
+    bool bad = r.mat_allocs_per_frame > 0 || r.allocs_per_frame[CAPTURE] > 0 ||
+               r.allocs_per_frame[DETECT] > 0;
+    failed = failed || bad;
+    std::cerr << (bad ? "ALLOCATES  " : "           ") << r.config.key()
+              << ": " << r.mat_allocs_per_frame << " Mat buffer(s), "
+              << r.allocs_per_frame[CAPTURE] << " capture and "
+              << r.allocs_per_frame[DETECT]
+              << " detect allocation(s) per frame over " << r.steady_frames
+              << " frames" << std::endl;
+  }
+  return failed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string sourceSpec = "synthetic";
+  std::vector<std::string> resolutions = {
+      std::to_string(static_cast<int>(CAP_WIDTH)) + "x" +
+      std::to_string(static_cast<int>(CAP_HEIGHT))};
+  std::vector<int> scales = {ANALYSIS_SCALE};
+  std::vector<int> blurs = {GAUSSIAN_BLUR_SIZE};
+  std::vector<int> qualities = {LIVE_JPEG_QUALITY};
+  int frames = 300, warmup = 10;
+  std::string format = "json", outPath, recordDir = "/tmp", baselinePath;
+  double tolerance = 10;
+  bool checkAllocs = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--source") {
+      sourceSpec = value;
+    } else if (name == "--resolutions") {
+      resolutions = splitList(value);
+    } else if (name == "--scales") {
+      scales = parseInts(value);
+    } else if (name == "--blur") {
+      blurs = parseInts(value);
+    } else if (name == "--quality") {
+      qualities = parseInts(value);
+    } else if (name == "--frames") {
+      frames = std::atoi(value.c_str());
+    } else if (name == "--warmup") {
+      warmup = std::atoi(value.c_str());
+    } else if (name == "--format" && (value == "json" || value == "csv")) {
+      format = value;
+    } else if (name == "--out") {
+      outPath = value;
+    } else if (name == "--record-dir") {
+      recordDir = value;
+    } else if (name == "--baseline") {
+      baselinePath = value;
+    } else if (name == "--tolerance") {
+      tolerance = std::atof(value.c_str());
+    } else if (name == "--check-allocations") {
+      checkAllocs = true;
+    } else {
+      std::cerr << "Unknown option " << arg
+                << "; see the top of motion_bench.cpp for usage." << std::endl;
+      return 1;
+    }
+  }
+  // The source is part of the config key, which is a CSV field and a JSON
+  // string, written unquoted.
+  if (sourceSpec.find_first_of(",\"\n") != std::string::npos) {
+    std::cerr << "[Bench] Error: --source must not contain ',', '\"' or a "
+                 "line break." << std::endl;
+    return 1;
+  }
+  if (frames <= 0 || warmup < 0) {
+    std::cerr << "[Bench] Error: --frames must be positive." << std::endl;
+    return 1;
+  }
+
+  installAllocationCounter();
+
+  // A file is replayed at its own size, so only one resolution is run.
+  if (sourceSpec != "synthetic") resolutions.resize(1);
+
+  std::vector<BenchResult> results;
+  for (const auto& resolution : resolutions) {
+    cv::Size size;
+    if (std::sscanf(resolution.c_str(), "%dx%d", &size.width, &size.height) !=
+        2) {
+      std::cerr << "[Bench] Error: Bad resolution " << resolution << std::endl;
+      return 1;
+    }
+    for (int scale : scales) {
+      for (int blur : blurs) {
+        for (int quality : qualities) {
+          BenchConfig config{sourceSpec, size, scale, blur, quality};
+          BenchResult result;
+          std::cerr << "[Bench] Running " << config.key() << std::endl;
+          if (!runConfig(config, frames, warmup, recordDir, result)) return 1;
+          results.push_back(result);
+        }
+      }
+    }
+  }
+
+  std::ofstream outFile;
+  if (!outPath.empty()) {
+    outFile.open(outPath);
+    if (!outFile) {
+      std::cerr << "[Bench] Error: Could not write " << outPath << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = outPath.empty() ? std::cout : outFile;
+  if (format == "csv") {
+    writeCsv(out, results);
+  } else {
+    writeJson(out, results);
+  }
+
+  if (!baselinePath.empty() &&
+      compareWithBaseline(results, baselinePath, tolerance)) {
+    return 2;
+  }
+  if (checkAllocs && checkAllocations(results)) return 3;
+  return 0;
+}
@@ -1,86 +1,158 @@
-#include <sys/stat.h>  // For mkdir
-
+#include <algorithm>
+#include <cstdlib>
 #include <thread>
+#include <vector>
 
+#include "camera.hpp"
 #include "defines.hpp"
 #include "utils.hpp"
 
-std::deque<MotionArtifact> gRecentDetections;
-std::mutex gDetectionMutex;  // Protects g_recentDetections
-
-cv::VideoCapture gCap;
-std::mutex gCameraMutex;  // Protects g_cap
+Metrics gMetrics;
+Governor gGovernor(GOVERNOR_TEMP_PATH);
+RetentionManager gRetention(RECORDINGS_DIR, RETENTION_MAX_BYTES,
+                            RETENTION_MIN_FREE_BYTES);
+StorageWriter gStorage(STORAGE_STAGING_DIR, STORAGE_BLOCK_BYTES,
+                       STORAGE_FSYNC_SECONDS);
 
 std::atomic<bool> gIsLiveStreamingActive{false};
 std::atomic<int> gLiveStreamClientCount{0};
 
 // --- Main Function ---
-int main() {
+// Options:
+//   --source=SPEC          frame source, see createFrameSource() (default
+//                          "camera"); repeat it to add cameras 1, 2, ...
+//   --pace=realtime|fast   pacing for file and synthetic sources
+//   --thermal-path=PATH    temperature file for the governor (millidegrees C)
+//   --retention-quota-mb=N     keep recordings under N MiB (0: no quota)
+//   --retention-min-free-mb=N  keep N MiB free on the disk (0: no floor)
+//   --classifier-model=PATH    DNN used to label clips ("" disables it)
+//   --classifier-config=PATH   its config file, if the format needs one
+//   --classifier-labels=PATH   its class names, one per line
+//   --staging-dir=PATH     RAM directory clips are staged in ("": none)
+//   --fsync=clip|N         sync each finished clip, or all clips every N s
+//   --export-socket-prefix=PATH  frame export sockets, PATH<id>.sock ("":
+//                                no frame export)
+int main(int argc, char** argv) {
   std::cout << "Application starting..." << std::endl;
-  std::cout << "Attempting to open camera index: " << CAMERA_INDEX << std::endl;
-  std::cout << "Requested Resolution: " << CAP_WIDTH << "x" << CAP_HEIGHT
-            << " @ " << CAP_FPS << "FPS" << std::endl;
-
-  {  // Scope for camera lock during initialization
-    std::lock_guard<std::mutex> lock(gCameraMutex);
-    gCap.open(CAMERA_INDEX);
-    if (!gCap.isOpened()) {
-      // Try GStreamer pipeline as a fallback for Raspberry Pi
-      std::string gstPipeline =
-          "v4l2src device=/dev/video" + std::to_string(CAMERA_INDEX) +
-          " ! video/x-raw,width=" +
-          std::to_string(static_cast<int>(CAP_WIDTH)) +
-          ",height=" + std::to_string(static_cast<int>(CAP_HEIGHT)) +
-          ",framerate=" + std::to_string(static_cast<int>(CAP_FPS)) + "/1" +
-          " ! videoconvert ! appsink";
-      std::cout << "Camera index " << CAMERA_INDEX
-                << " failed. Trying GStreamer: " << gstPipeline << std::endl;
-      gCap.open(gstPipeline, cv::CAP_GSTREAMER);
-    }
 
-    if (!gCap.isOpened()) {
-      std::cerr << "Error: Could not open camera using index " << CAMERA_INDEX
-                << " or GStreamer. Exiting." << std::endl;
+  std::vector<std::string> sourceSpecs;
+  bool realtime = true;
+  uint64_t retentionMaxBytes = RETENTION_MAX_BYTES;
+  uint64_t retentionMinFreeBytes = RETENTION_MIN_FREE_BYTES;
+  std::string classifierModel = CLASSIFIER_MODEL_PATH;
+  std::string classifierConfig = CLASSIFIER_CONFIG_PATH;
+  std::string classifierLabels = CLASSIFIER_LABELS_PATH;
+  std::string exportSocketPrefix = FRAME_EXPORT_SOCKET_PREFIX;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--source=", 0) == 0) {
+      sourceSpecs.push_back(arg.substr(9));
+    } else if (arg == "--pace=realtime" || arg == "--pace=fast") {
+      realtime = arg == "--pace=realtime";
+    } else if (arg.rfind("--thermal-path=", 0) == 0) {
+      gGovernor.setTemperaturePath(arg.substr(15));
+    } else if (arg.rfind("--retention-quota-mb=", 0) == 0) {
+      retentionMaxBytes = std::strtoull(arg.c_str() + 21, nullptr, 10) << 20;
+    } else if (arg.rfind("--retention-min-free-mb=", 0) == 0) {
+      retentionMinFreeBytes = std::strtoull(arg.c_str() + 24, nullptr, 10)
+                              << 20;
+    } else if (arg.rfind("--classifier-model=", 0) == 0) {
+      classifierModel = arg.substr(19);
+    } else if (arg.rfind("--classifier-config=", 0) == 0) {
+      classifierConfig = arg.substr(20);
+    } else if (arg.rfind("--classifier-labels=", 0) == 0) {
+      classifierLabels = arg.substr(20);
+    } else if (arg.rfind("--staging-dir=", 0) == 0) {
+      gStorage.setStagingDir(arg.substr(14));
+    } else if (arg == "--fsync=clip") {
+      gStorage.setFsyncSeconds(0);
+    } else if (arg.rfind("--fsync=", 0) == 0 &&
+               std::atoi(arg.c_str() + 8) > 0) {
+      gStorage.setFsyncSeconds(std::atoi(arg.c_str() + 8));
+    } else if (arg.rfind("--export-socket-prefix=", 0) == 0) {
+      exportSocketPrefix = arg.substr(23);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--source=camera[:INDEX]|file:PATH|"
+                   "synthetic[:WxH[@FPS]][:S-E,...]]... [--pace=realtime|fast]"
+                   " [--thermal-path=PATH] [--retention-quota-mb=N]"
+                   " [--retention-min-free-mb=N] [--classifier-model=PATH]"
+                   " [--classifier-config=PATH] [--classifier-labels=PATH]"
+                   " [--staging-dir=PATH] [--fsync=clip|N]"
+                   " [--export-socket-prefix=PATH]"
+                << std::endl;
       return -1;
     }
+  }
 
-    // Set camera parameters (some might not be settable if using GStreamer
-    // pipeline string directly)
-    gCap.set(cv::CAP_PROP_FRAME_WIDTH, CAP_WIDTH);
-    gCap.set(cv::CAP_PROP_FRAME_HEIGHT, CAP_HEIGHT);
-    // gCap.set(cv::CAP_PROP_FPS, CAP_FPS);
+  if (sourceSpecs.empty()) sourceSpecs.push_back("camera");
+  gRetention.setLimits(retentionMaxBytes, retentionMinFreeBytes);
+  if (!gStorage.prepare()) {
+    std::cerr << "Warning: No staging directory, clips are written straight "
+                 "to the card." << std::endl;
   }
 
-  std::cout << "Camera opened successfully." << std::endl;
-  std::cout << "Actual Resolution: " << gCap.get(cv::CAP_PROP_FRAME_WIDTH)
-            << "x" << gCap.get(cv::CAP_PROP_FRAME_HEIGHT) << std::endl;
-  std::cout << "Actual FPS: " << gCap.get(cv::CAP_PROP_FPS) << std::endl;
+  for (const std::string& spec : sourceSpecs) {
+    int id = static_cast<int>(gCameras.size());
+    std::unique_ptr<FrameSource> source = createFrameSource(spec, realtime);
+    if (!source) {
+      std::cerr << "Error: Unrecognised frame source '" << spec
+                << "'. Exiting." << std::endl;
+      return -1;
+    }
+    if (!source->open()) {
+      std::cerr << "Error: Could not open " << source->description()
+                << ". Exiting." << std::endl;
+      return -1;
+    }
+    std::cout << "Camera " << id << ": " << source->description() << ", "
+              << source->frameSize().width << "x"
+              << source->frameSize().height << " at " << source->fps()
+              << " FPS" << std::endl;
 
-  // Ensure recordings directory exists before starting threads that might use
-  // it
-  if (mkdir(RECORDINGS_DIR.c_str(), 0755) != 0 && errno != EEXIST) {
-    perror("Failed to create recordings directory");
-    // Decide if this is a fatal error
-  } else {
-    std::cout << "Recordings will be saved to ./" << RECORDINGS_DIR
-              << std::endl;
+    auto camera = std::make_unique<Camera>(id, std::move(source));
+    if (!camera->openStorage()) {
+      std::cerr << "Warning: Detection index of camera " << id
+                << " unavailable, new clips will not be listed."
+                << std::endl;
+    }
+    std::cout << "Camera " << id << " recordings will be saved to ./"
+              << camera->recordings_dir << std::endl;
+    camera->classifier.setModel(classifierModel, classifierConfig,
+                                classifierLabels);
+    if (!exportSocketPrefix.empty() &&
+        !camera->exporter.open(exportSocketPrefix + std::to_string(id) +
+                               ".sock")) {
+      std::cerr << "Warning: Frames of camera " << id
+                << " will not be exported." << std::endl;
+    }
+    gCameras.push_back(std::move(camera));
   }
 
-  std::thread camThread(motionDetectionLoop);
+  // gCameras is complete before any thread that iterates it starts.
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (const auto& camera : gCameras) {
+    camera->start(PIPELINE_PIN_DETECTORS
+                      ? static_cast<int>(camera->id % cores)
+                      : -1);
+  }
   std::thread webThread(startHttpServer);
+  std::thread governorThread(&Governor::run, &gGovernor);
+  std::thread retentionThread(&RetentionManager::run, &gRetention);
+  std::thread storageThread(&StorageWriter::run, &gStorage);
 
-  std::cout << "Main: Motion detection and HTTP server threads started."
+  std::cout << "Main: " << gCameras.size()
+            << " camera pipeline(s), HTTP server, governor, retention and "
+               "storage threads started."
             << std::endl;
 
-  camThread.join();
+  for (const auto& camera : gCameras) camera->join();
   webThread.join();
+  governorThread.join();
+  retentionThread.join();
+  storageThread.join();
 
-  {  // Scope for camera lock during release
-    std::lock_guard<std::mutex> lock(gCameraMutex);
-    if (gCap.isOpened()) {
-      gCap.release();
-    }
-  }
+  gCameras.clear();
   std::cout << "Application terminated." << std::endl;
   return 0;
 }
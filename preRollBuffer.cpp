@@ -0,0 +1,56 @@
+#include "preRollBuffer.hpp"
+
+PreRollBuffer::PreRollBuffer(size_t arenaBytes,
+                             std::chrono::milliseconds window,
+                             size_t maxFrames, int jpegQuality)
+    : arena_(arenaBytes),
+      entries_(maxFrames),
+      window_(window),
+      encodeParams_{cv::IMWRITE_JPEG_QUALITY, jpegQuality} {}
+
+void PreRollBuffer::popOldest() {
+  first_ = (first_ + 1) % entries_.size();
+  count_--;
+}
+
+void PreRollBuffer::push(const cv::Mat& image, Clock::time_point captureTime) {
+  if (!enabled() || entries_.empty()) return;
+
+  // Age out frames that have fallen outside the pre-roll window.
+  while (count_ > 0 && captureTime - oldest().capture_time > window_) {
+    popOldest();
+  }
+  if (count_ == entries_.size()) popOldest();
+
+  cv::imencode(".jpg", image, encodeBuf_, encodeParams_);
+  size_t size = encodeBuf_.size();
+  if (size == 0 || size > arena_.size()) return;  // Can never fit, skip it
+
+  // Live data occupies [oldest().offset, writePos_) circularly. Frames are
+  // stored contiguously, so if this one would run off the end of the arena
+  // the tail is abandoned (evicting whatever still lives there) and we wrap.
+  size_t pos = writePos_;
+  if (pos + size > arena_.size()) {
+    while (count_ > 0 && oldest().offset >= pos) popOldest();
+    pos = 0;
+  }
+  while (count_ > 0 && oldest().offset >= pos && oldest().offset < pos + size) {
+    popOldest();
+  }
+
+  std::copy(encodeBuf_.begin(), encodeBuf_.end(), arena_.begin() + pos);
+  Entry& entry = entries_[(first_ + count_) % entries_.size()];
+  entry.offset = pos;
+  entry.size = size;
+  entry.capture_time = captureTime;
+  count_++;
+  writePos_ = pos + size;
+}
+
+void PreRollBuffer::drain(const Sink& sink) {
+  for (size_t i = 0; i < count_; ++i) {
+    const Entry& entry = entries_[(first_ + i) % entries_.size()];
+    sink(arena_.data() + entry.offset, entry.size, entry.capture_time);
+  }
+  clear();
+}
@@ -0,0 +1,58 @@
+#ifndef PRE_ROLL_BUFFER
+#define PRE_ROLL_BUFFER
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Rolling history of the last few seconds of frames, kept JPEG-compressed in
+// one arena that is allocated up front. Frames are appended at the write
+// position and the oldest ones are evicted to make room, so memory use is flat
+// no matter how long the camera runs. When motion triggers, drain() hands the
+// history to the recorder so clips start before the triggering frame.
+class PreRollBuffer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Sink = std::function<void(const uchar* jpeg, size_t size,
+                                  Clock::time_point captureTime)>;
+
+  // `arenaBytes` bounds the compressed history, `window` how far back it
+  // reaches and `maxFrames` the number of index entries.
+  PreRollBuffer(size_t arenaBytes, std::chrono::milliseconds window,
+                size_t maxFrames, int jpegQuality);
+
+  void push(const cv::Mat& image, Clock::time_point captureTime);
+
+  // Passes every buffered frame to `sink`, oldest first, then empties the
+  // history. The pointer is only valid for the duration of the call.
+  void drain(const Sink& sink);
+
+  void clear() { count_ = 0; }
+  size_t size() const { return count_; }
+  bool enabled() const { return window_.count() > 0 && !arena_.empty(); }
+
+ private:
+  struct Entry {
+    size_t offset = 0;
+    size_t size = 0;
+    Clock::time_point capture_time;
+  };
+
+  const Entry& oldest() const { return entries_[first_]; }
+  void popOldest();
+
+  std::vector<uchar> arena_;
+  std::vector<Entry> entries_;  // Ring indexed from first_
+  size_t first_ = 0;
+  size_t count_ = 0;
+  size_t writePos_ = 0;  // Arena offset right after the newest frame
+  std::chrono::milliseconds window_;
+
+  // Reused for every encode so its capacity settles after the first frames.
+  std::vector<uchar> encodeBuf_;
+  std::vector<int> encodeParams_;
+};
+
+#endif /* PRE_ROLL_BUFFER */
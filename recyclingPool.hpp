@@ -0,0 +1,77 @@
+#ifndef RECYCLING_POOL
+#define RECYCLING_POOL
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Reusable objects handed out as ordinary shared_ptrs, for per-frame data
+// whose buffers should be allocated once rather than every frame. The pool
+// keeps one reference to each object and treats an object whose only owner is
+// the pool as free, so consumers recycle objects simply by dropping their
+// references; nothing has to be returned explicitly.
+//
+// acquire() may only be called from one thread (the producer). It grows the
+// pool by one object while every object is in use, up to `maxObjects`, so
+// after warm-up it settles at the pipeline's high-water mark and stops
+// allocating. Beyond `maxObjects` it hands out objects outside the pool
+// rather than fail, and counts them as overflows.
+template <typename T>
+class RecyclingPool {
+ public:
+  explicit RecyclingPool(size_t maxObjects) : maxObjects_(maxObjects) {
+    objects_.reserve(maxObjects);
+  }
+  RecyclingPool(const RecyclingPool&) = delete;
+  RecyclingPool& operator=(const RecyclingPool&) = delete;
+
+  // Creates `count` objects up front, each set up by `init(T&)`.
+  template <typename Init>
+  void preallocate(size_t count, Init init) {
+    while (objects_.size() < count && objects_.size() < maxObjects_) {
+      objects_.push_back(std::make_shared<T>());
+      init(*objects_.back());
+    }
+    size_.store(objects_.size(), std::memory_order_relaxed);
+  }
+
+  // Returns an object no one else references. Its contents are whatever the
+  // previous user left in it.
+  std::shared_ptr<T> acquire() {
+    for (size_t i = 0; i < objects_.size(); ++i) {
+      size_t index = (next_ + i) % objects_.size();
+      if (objects_[index].use_count() == 1) {
+        // Pairs with the release in the last consumer's reference drop, so
+        // its reads of the object happen before our writes.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        next_ = index + 1;
+        return objects_[index];
+      }
+    }
+    if (objects_.size() < maxObjects_) {
+      objects_.push_back(std::make_shared<T>());
+      size_.store(objects_.size(), std::memory_order_relaxed);
+      next_ = 0;
+      return objects_.back();
+    }
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<T>();
+  }
+
+  // Objects owned by the pool; safe from any thread.
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  uint64_t overflows() const {
+    return overflows_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const size_t maxObjects_;
+  std::vector<std::shared_ptr<T>> objects_;  // Producer thread only
+  size_t next_ = 0;  // Where the next scan starts, spreads reuse evenly
+  std::atomic<size_t> size_{0};
+  std::atomic<uint64_t> overflows_{0};
+};
+
+#endif /* RECYCLING_POOL */
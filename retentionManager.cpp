@@ -0,0 +1,129 @@
+#include "retentionManager.hpp"
+
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#include "camera.hpp"
+#include "defines.hpp"
+#include "utils.hpp"
+
+RetentionManager::RetentionManager(std::string recordingsDir,
+                                   uint64_t maxBytes, uint64_t minFreeBytes)
+    : recordingsDir_(std::move(recordingsDir)),
+      maxBytes_(maxBytes),
+      minFreeBytes_(minFreeBytes) {}
+
+void RetentionManager::notify() {
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex_);
+    pending_ = true;
+  }
+  wake_.notify_one();
+}
+
+bool RetentionManager::overLimit() {
+  struct statvfs fs {};
+  if (statvfs(recordingsDir_.c_str(), &fs) == 0) {
+    freeBytes_.store(static_cast<uint64_t>(fs.f_bavail) * fs.f_frsize,
+                     std::memory_order_relaxed);
+  }
+  uint64_t used = 0;
+  for (const auto& camera : gCameras) used += camera->index.liveBytes();
+  usedBytes_.store(used, std::memory_order_relaxed);
+  if (maxBytes_ > 0 && used > maxBytes_) return true;
+  return minFreeBytes_ > 0 && freeBytes() < minFreeBytes_;
+}
+
+// Returns false once this check has no clips left to try.
+bool RetentionManager::evictOldest() {
+  Camera* camera = nullptr;
+  size_t chosen = 0;
+  DetectionRecord record;
+  for (size_t i = 0; i < gCameras.size(); ++i) {
+    DetectionRecord candidate;
+    if (gCameras[i]->index.oldestLive(scan_[i], candidate) &&
+        (!camera || candidate.start_ms < record.start_ms)) {
+      camera = gCameras[i].get();
+      chosen = i;
+      record = candidate;
+    }
+  }
+  if (!camera) return false;
+  uint64_t position = scan_[chosen]++;
+
+  // The clip is only unlisted once it is gone, so one that can't be deleted
+  // stays counted. This check moves on to the next oldest, and later ones
+  // retry it. A download already in progress keeps its open descriptor; a
+  // request in between gets a 404.
+  std::string path = camera->recordings_dir + "/" + record.name();
+  if (unlink(path.c_str()) == 0) {
+    reclaimedBytes_.fetch_add(record.size_bytes, std::memory_order_relaxed);
+  } else if (errno != ENOENT) {
+    perror(("[Retention] Failed to delete " + path).c_str());
+    return true;
+  }
+  if (!camera->index.markDeleted(position)) return true;
+  if (record.flags & DetectionRecord::HAS_THUMBNAIL) {
+    camera->thumbnails.remove(record.name());
+  }
+  if (record.flags & DetectionRecord::HAS_TIMELINE) {
+    std::string timeline =
+        camera->recordings_dir + "/" + timelineNameFor(record.name());
+    if (unlink(timeline.c_str()) != 0 && errno != ENOENT) {
+      perror(("[Retention] Failed to delete " + timeline).c_str());
+    }
+  }
+  evictedClips_.fetch_add(1, std::memory_order_relaxed);
+  std::cout << "[Retention] Deleted " << record.name() << " ("
+            << record.size_bytes << " bytes)" << std::endl;
+  return true;
+}
+
+void RetentionManager::run() {
+  std::cout << "[Retention] Starting retention loop, quota " << maxBytes_
+            << " bytes, free-space floor " << minFreeBytes_ << " bytes."
+            << std::endl;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(wakeMutex_);
+      wake_.wait_for(lock, std::chrono::seconds(RETENTION_INTERVAL_SECONDS),
+                     [this] { return pending_; });
+      pending_ = false;
+    }
+
+    // oldest_ catches up with what the last check deleted, stopping at any
+    // clip it could not.
+    oldest_.resize(gCameras.size(), 0);
+    for (size_t i = 0; i < gCameras.size(); ++i) {
+      DetectionRecord record;
+      gCameras[i]->index.oldestLive(oldest_[i], record);
+    }
+    scan_ = oldest_;
+    bool candidatesLeft = true;
+    while (overLimit()) {
+      for (int i = 0;
+           i < RETENTION_BATCH_CLIPS && candidatesLeft && overLimit(); ++i) {
+        candidatesLeft = evictOldest();
+      }
+      if (!candidatesLeft) {
+        // Nothing left that we may delete: the quota is smaller than what
+        // is being recorded right now, the disk is full of other files, or
+        // the remaining clips could not be deleted.
+        std::cerr << "[Retention] Warning: Still over limit with no clips "
+                     "left to delete."
+                  << std::endl;
+        break;
+      }
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(RETENTION_BATCH_PAUSE_MS));
+    }
+  }
+  std::cout << "[Retention] Exiting retention loop." << std::endl;
+}
@@ -0,0 +1,77 @@
+#ifndef RETENTION_MANAGER
+#define RETENTION_MANAGER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Keeps RECORDINGS_DIR within a byte quota and above a free-space floor by
+// deleting the oldest clips. The quota covers all cameras together, and the
+// oldest clip of any camera goes first. Sizes come from the cameras' detection
+// indexes, so no directory is ever rescanned; only statvfs() is called, once
+// per check.
+//
+// Clips are evicted a few at a time with a pause between batches, so a big
+// backlog (e.g. after lowering the quota) is worked off without a burst of
+// unlinks competing with the recorder for the SD card. The index lock is
+// only taken for single-record lookups and flag updates.
+class RetentionManager {
+ public:
+  RetentionManager(std::string recordingsDir, uint64_t maxBytes,
+                   uint64_t minFreeBytes);
+
+  // Must be called before run() starts. 0 disables the respective limit.
+  void setLimits(uint64_t maxBytes, uint64_t minFreeBytes) {
+    maxBytes_ = maxBytes;
+    minFreeBytes_ = minFreeBytes;
+  }
+
+  // Retention thread entry point.
+  void run();
+
+  // Asks for a check now, e.g. after a clip was finished. Never blocks.
+  void notify();
+
+  uint64_t evictedClips() const {
+    return evictedClips_.load(std::memory_order_relaxed);
+  }
+  uint64_t reclaimedBytes() const {
+    return reclaimedBytes_.load(std::memory_order_relaxed);
+  }
+  // Free space on the recordings file system and bytes of indexed clips,
+  // both as of the last check.
+  uint64_t freeBytes() const {
+    return freeBytes_.load(std::memory_order_relaxed);
+  }
+  uint64_t usedBytes() const {
+    return usedBytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  bool overLimit();
+  bool evictOldest();
+
+  const std::string recordingsDir_;
+  uint64_t maxBytes_;
+  uint64_t minFreeBytes_;
+
+  std::mutex wakeMutex_;
+  std::condition_variable wake_;
+  bool pending_ = false;
+
+  // Per camera, the index position below which everything is deleted
+  std::vector<uint64_t> oldest_;
+  // Per camera, where the current check continues its search. It moves past
+  // clips that could not be deleted, while oldest_ stays at them so the next
+  // check retries them.
+  std::vector<uint64_t> scan_;
+  std::atomic<uint64_t> evictedClips_{0};
+  std::atomic<uint64_t> reclaimedBytes_{0};
+  std::atomic<uint64_t> freeBytes_{0};
+  std::atomic<uint64_t> usedBytes_{0};
+};
+
+#endif /* RETENTION_MANAGER */
@@ -1,12 +1,445 @@
+#include <fcntl.h>
+#include <linux/sockios.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "camera.hpp"
 #include "defines.hpp"
 #include "utils.hpp"
 
+namespace {
+
+std::atomic<int> gOpenConnections{0};  // Across all workers
+
+// Upper bound per sendfile() call, see flush().
+const size_t SENDFILE_CHUNK = 1024 * 1024;
+
+bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// One event loop thread. Each worker has its own epoll instance and owns the
+// connections it accepts, so connection state is never shared between threads.
+class HttpWorker {
+ public:
+  explicit HttpWorker(int listenFd) : listenFd_(listenFd) {}
+  void run();
+
+ private:
+  void acceptConnections();
+  // These return false when the connection should be closed.
+  bool onReadable(HttpConnection& conn);
+  bool flush(HttpConnection& conn);
+  bool feedLiveStream(HttpConnection& conn);
+  bool adaptLiveTier(HttpConnection& conn);
+  void setWantWrite(HttpConnection& conn, bool want);
+  void updateEvents(HttpConnection& conn);
+  void onStreamWake();
+  void closeIdleConnections();
+  void closeConnection(int fd);
+
+  int listenFd_;
+  int epollFd_ = -1;
+  // Signalled by every camera's live hub when a new frame is encoded and by
+  // its detection index when a detection is added or removed
+  int eventFd_ = -1;
+  std::unordered_map<int, HttpConnection> connections_;
+};
+
+void HttpWorker::run() {
+  epollFd_ = epoll_create1(0);
+  eventFd_ = eventfd(0, EFD_NONBLOCK);
+  if (epollFd_ < 0 || eventFd_ < 0) {
+    perror("[HttpServer] epoll/eventfd creation failed");
+    return;
+  }
+
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;  // Wake one worker per connection
+  ev.data.fd = listenFd_;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+  ev.events = EPOLLIN;
+  ev.data.fd = eventFd_;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &ev);
+  for (const auto& camera : gCameras) {
+    camera->live.addListener(eventFd_);
+    camera->index.addListener(eventFd_);
+  }
+
+  std::vector<epoll_event> events(64);
+  auto lastSweep = std::chrono::steady_clock::now();
+
+  while (true) {
+    int count = epoll_wait(epollFd_, events.data(),
+                           static_cast<int>(events.size()), 1000);
+    if (count < 0) {
+      if (errno != EINTR) perror("[HttpServer] epoll_wait failed");
+      continue;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == listenFd_) {
+        acceptConnections();
+        continue;
+      }
+      if (fd == eventFd_) {
+        onStreamWake();
+        continue;
+      }
+
+      auto it = connections_.find(fd);
+      if (it == connections_.end()) continue;
+      HttpConnection& conn = it->second;
+
+      bool keep = !(events[i].events & (EPOLLERR | EPOLLHUP));
+      if (keep && (events[i].events & EPOLLIN)) keep = onReadable(conn);
+      if (keep && (events[i].events & EPOLLOUT)) keep = flush(conn);
+      if (!keep) closeConnection(fd);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSweep >= std::chrono::seconds(1)) {
+      closeIdleConnections();
+      lastSweep = now;
+    }
+  }
+}
+
+void HttpWorker::acceptConnections() {
+  while (true) {
+    sockaddr_in clientAddr{};
+    socklen_t clientAddrLen = sizeof(clientAddr);
+    int clientFd = accept4(listenFd_, (sockaddr*)&clientAddr, &clientAddrLen,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientFd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("[HttpServer] accept failed");
+      }
+      return;  // Another worker may have taken it, or the backlog is empty
+    }
+
+    // Claimed before the check, so workers accepting at the same time
+    // can't all slip under the limit.
+    if (gOpenConnections.fetch_add(1, std::memory_order_relaxed) >=
+        HTTP_MAX_CONNECTIONS) {
+      gOpenConnections.fetch_sub(1, std::memory_order_relaxed);
+      static const char busy[] =
+          "HTTP/1.1 503 Service Unavailable\r\nContent-Type: "
+          "text/plain\r\nConnection: close\r\n\r\nToo many connections.";
+      send(clientFd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);  // Best effort
+      close(clientFd);
+      std::cerr << "[HttpServer] Connection limit reached, rejected client."
+                << std::endl;
+      continue;
+    }
+
+    HttpConnection& conn = connections_[clientFd];
+    conn.fd = clientFd;
+    conn.last_activity = std::chrono::steady_clock::now();
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = clientFd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, clientFd, &ev) < 0) {
+      perror("[HttpServer] epoll_ctl add failed");
+      closeConnection(clientFd);
+    }
+  }
+}
+
+bool HttpWorker::onReadable(HttpConnection& conn) {
+  char buffer[2048];
+  bool peerClosed = false;
+  while (true) {
+    ssize_t bytesRead = recv(conn.fd, buffer, sizeof(buffer), 0);
+    if (bytesRead == 0) {
+      peerClosed = true;
+      break;
+    }
+    if (bytesRead < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (errno == EINTR) continue;
+      return false;
+    }
+    conn.last_activity = std::chrono::steady_clock::now();
+    // Once the request is parsed anything else the client sends is ignored;
+    // we only keep reading to notice when it goes away.
+    if (conn.state == HttpConnection::State::ReadingRequest) {
+      conn.request.append(buffer, bytesRead);
+    }
+  }
+
+  if (peerClosed) {
+    // A live viewer or event subscriber closing its side is gone. Other
+    // clients may half-close right after sending the request, so they still
+    // get their response; we just stop polling for input (EOF would keep the
+    // fd readable forever).
+    if (conn.state == HttpConnection::State::Streaming ||
+        conn.state == HttpConnection::State::EventStream) {
+      return false;
+    }
+    conn.read_closed = true;
+    updateEvents(conn);
+  }
+
+  if (conn.state != HttpConnection::State::ReadingRequest) return true;
+
+  if (conn.request.find("\r\n\r\n") != std::string::npos) {
+    handleHttpClient(conn);
+    return flush(conn);
+  }
+  if (peerClosed) return false;  // Gave up before finishing the request
+  if (conn.request.size() > HTTP_MAX_REQUEST_BYTES) {
+    conn.queue(
+        "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Type: "
+        "text/plain\r\nConnection: close\r\n\r\nRequest too large.");
+    conn.state = HttpConnection::State::Writing;
+    return flush(conn);
+  }
+  return true;  // Wait for the rest of the header
+}
+
+bool HttpWorker::flush(HttpConnection& conn) {
+  while (true) {
+    while (!conn.out.empty()) {
+      iovec iov[16];
+      size_t iovCount = 0;
+      for (const auto& chunk : conn.out) {
+        if (iovCount == 16) break;
+        iov[iovCount].iov_base = const_cast<char*>(chunk.data);
+        iov[iovCount].iov_len = chunk.size;
+        iovCount++;
+      }
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = iovCount;
+
+      auto sendStart = std::chrono::steady_clock::now();
+      ssize_t sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+      gMetrics.send_seconds.observe(std::chrono::steady_clock::now() -
+                                    sendStart);
+      if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          setWantWrite(conn, true);  // Resume when the socket drains
+          return true;
+        }
+        if (errno == EINTR) continue;
+        return false;
+      }
+      conn.last_activity = std::chrono::steady_clock::now();
+      gMetrics.http_bytes_sent.add(static_cast<uint64_t>(sent));
+
+      // Drop fully written chunks, trim a partially written one.
+      size_t remaining = static_cast<size_t>(sent);
+      while (remaining > 0) {
+        OutChunk& front = conn.out.front();
+        if (remaining >= front.size) {
+          remaining -= front.size;
+          conn.out.pop_front();
+        } else {
+          front.data += remaining;
+          front.size -= remaining;
+          remaining = 0;
+        }
+      }
+    }
+
+    // The file body goes straight from the page cache to the socket, one
+    // chunk per wakeup so a large download can't starve the other sockets
+    // on this worker.
+    if (conn.file_remaining > 0) {
+      auto sendStart = std::chrono::steady_clock::now();
+      ssize_t sent = sendfile(conn.fd, conn.file_fd, &conn.file_offset,
+                              std::min(conn.file_remaining, SENDFILE_CHUNK));
+      gMetrics.send_seconds.observe(std::chrono::steady_clock::now() -
+                                    sendStart);
+      if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+          errno != EINTR) {
+        return false;
+      }
+      if (sent == 0) return false;  // File shrank underneath us
+      if (sent > 0) {
+        conn.file_remaining -= static_cast<size_t>(sent);
+        gMetrics.http_bytes_sent.add(static_cast<uint64_t>(sent));
+        conn.last_activity = std::chrono::steady_clock::now();
+      }
+      if (conn.file_remaining > 0) {
+        setWantWrite(conn, true);
+        return true;
+      }
+    }
+    setWantWrite(conn, false);
+
+    if (conn.state == HttpConnection::State::Writing) return false;  // Done
+    if (conn.state == HttpConnection::State::Streaming) {
+      if (!feedLiveStream(conn)) return true;  // Wait for the next frame
+    } else if (conn.state == HttpConnection::State::EventStream) {
+      if (!feedDetectionEvents(conn)) return true;  // Wait for a detection
+    } else {
+      return true;
+    }
+  }
+}
+
+bool HttpWorker::feedLiveStream(HttpConnection& conn) {
+  LiveStreamHub& live = conn.camera->live;
+  // Only the newest frame is ever queued, and only once the previous one has
+  // been fully written, so a slow client skips frames instead of buffering.
+  EncodedFramePtr frame = live.newestAfter(conn.live_tier, conn.live_cursor);
+  if (!frame) return false;
+  if (frame->capture_time - conn.live_last_capture < conn.live_min_interval) {
+    conn.live_cursor = frame->sequence;  // Over the client's ?fps= cap
+    return false;
+  }
+  int tier = conn.live_tier;
+  if (!adaptLiveTier(conn)) {
+    conn.live_cursor = frame->sequence;  // Let the socket catch up first
+    return false;
+  }
+  if (conn.live_tier != tier) {
+    // The new tier is encoded from the next frame on if nobody else was
+    // watching it.
+    frame = live.newestAfter(conn.live_tier, conn.live_cursor);
+    if (!frame) return false;
+  }
+  conn.live_cursor = frame->sequence;
+  conn.live_last_capture = frame->capture_time;
+  conn.live_last_bytes = frame->jpeg.size();
+  conn.queue(frame, frame->part_header.data(), frame->part_header.size());
+  conn.queue(frame, frame->jpeg.data(), frame->jpeg.size());
+  return true;
+}
+
+// Picks a live connection's tier from what is still waiting in its kernel
+// send queue when the next frame is due. More than LIVE_BACKLOG_FRAMES frames
+// means the client can't keep up: it moves one tier down and is sent nothing
+// until the queue has drained, which also bounds its latency. After
+// LIVE_STEP_UP_FRAMES frames in a row found the queue empty it moves one tier
+// back up, never past the tier it asked for. Returns false while backed up.
+bool HttpWorker::adaptLiveTier(HttpConnection& conn) {
+  int unsent = 0;  // Bytes the kernel has not sent yet (acked or not)
+  if (conn.live_last_bytes == 0 || ioctl(conn.fd, SIOCOUTQNSD, &unsent) < 0) {
+    return true;  // Nothing sent yet to judge by
+  }
+  int tier = conn.live_tier;
+  if (conn.live_backed_up) {
+    if (unsent > 0) return false;
+    conn.live_backed_up = false;
+  } else if (static_cast<size_t>(unsent) >
+             conn.live_last_bytes * LIVE_BACKLOG_FRAMES) {
+    conn.live_backed_up = true;
+    conn.live_calm_frames = 0;
+    if (tier + 1 < LiveStreamHub::TIER_COUNT) ++tier;
+  } else if (unsent > 0) {
+    conn.live_calm_frames = 0;
+  } else if (++conn.live_calm_frames >= LIVE_STEP_UP_FRAMES) {
+    conn.live_calm_frames = 0;
+    if (tier > conn.live_best_tier) --tier;
+  }
+
+  if (tier != conn.live_tier) {
+    conn.camera->live.moveClient(conn.live_tier, tier);
+    conn.live_tier = tier;
+    gMetrics.live_tier_changes.add();
+  }
+  return !conn.live_backed_up;
+}
+
+void HttpWorker::setWantWrite(HttpConnection& conn, bool want) {
+  if (conn.want_write == want) return;
+  conn.want_write = want;
+  updateEvents(conn);
+}
+
+void HttpWorker::updateEvents(HttpConnection& conn) {
+  epoll_event ev{};
+  ev.events = (conn.read_closed ? 0 : EPOLLIN | EPOLLRDHUP) |
+              (conn.want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+  ev.data.fd = conn.fd;
+  epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+void HttpWorker::onStreamWake() {
+  uint64_t counter;
+  while (read(eventFd_, &counter, sizeof(counter)) > 0) {
+  }
+
+  std::vector<int> toClose;
+  for (auto& entry : connections_) {
+    HttpConnection& conn = entry.second;
+    bool stream = conn.state == HttpConnection::State::Streaming ||
+                  conn.state == HttpConnection::State::EventStream;
+    if (!stream || !conn.out.empty()) {
+      continue;  // Still busy with an older frame or event
+    }
+    if (!flush(conn)) toClose.push_back(entry.first);
+  }
+  for (int fd : toClose) closeConnection(fd);
+}
+
+void HttpWorker::closeIdleConnections() {
+  auto now = std::chrono::steady_clock::now();
+  std::vector<int> toClose;
+  for (auto& entry : connections_) {
+    HttpConnection& conn = entry.second;
+    // A stream is only idle if it is stuck behind unsent data; waiting for
+    // the next frame with an empty queue is normal.
+    bool streamingAndDrained =
+        (conn.state == HttpConnection::State::Streaming ||
+         conn.state == HttpConnection::State::EventStream) &&
+        conn.out.empty();
+    // Quiet event streams get a comment line now and then, so proxies keep
+    // them open and a vanished client is noticed.
+    if (streamingAndDrained &&
+        conn.state == HttpConnection::State::EventStream &&
+        now - conn.last_activity >
+            std::chrono::seconds(SSE_KEEPALIVE_SECONDS)) {
+      conn.queue(": keepalive\n\n");
+      if (!flush(conn)) toClose.push_back(entry.first);
+      continue;
+    }
+    if (!streamingAndDrained &&
+        now - conn.last_activity >
+            std::chrono::seconds(HTTP_IDLE_TIMEOUT_SECONDS)) {
+      toClose.push_back(entry.first);
+    }
+  }
+  for (int fd : toClose) {
+    std::cout << "[HttpServer] Closing idle connection." << std::endl;
+    closeConnection(fd);
+  }
+}
+
+void HttpWorker::closeConnection(int fd) {
+  auto it = connections_.find(fd);
+  if (it == connections_.end()) return;
+  handleHttpClientClosed(it->second);
+  if (it->second.file_fd >= 0) close(it->second.file_fd);
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  connections_.erase(it);
+  gOpenConnections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
 void startHttpServer() {
   int serverFd = socket(AF_INET, SOCK_STREAM, 0);
   if (serverFd == -1) {
@@ -39,27 +472,25 @@ void startHttpServer() {
     return;
   }
 
+  if (!setNonBlocking(serverFd)) {
+    perror("[HttpServer] fcntl O_NONBLOCK failed");
+    close(serverFd);
+    return;
+  }
+
   std::cout << "[HttpServer] Serving on http://0.0.0.0:" << HTTP_PORT
+            << " with " << HTTP_WORKER_THREADS << " worker thread(s)"
             << std::endl;
 
-  while (true) {
-    sockaddr_in clientAddr{};
-    socklen_t clientAddrLen = sizeof(clientAddr);
-    int clientFd = accept(serverFd, (sockaddr*)&clientAddr, &clientAddrLen);
-
-    if (clientFd < 0) {
-      perror("[HttpServer] accept failed");
-      continue;  // Continue to accept other connections
-    }
-
-    // For simplicity, handling each client sequentially.
-    // For concurrent handling, you'd typically spawn a new thread here:
-    // std::thread(handleHttpClient, clientFd).detach();
-    // However, for RPi Zero, sequential might be more stable without careful
-    // thread management. The /live endpoint itself is blocking for that
-    // connection.
-    handleHttpClient(
-        clientFd);  // This will block for /live until client disconnects
+  // A fixed pool of event loops; this thread runs the last one. Long-lived
+  // /live streams and short requests are multiplexed on the same threads.
+  std::vector<HttpWorker> workers(HTTP_WORKER_THREADS, HttpWorker(serverFd));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workers.size(); ++i) {
+    threads.emplace_back(&HttpWorker::run, &workers[i]);
   }
-  close(serverFd);  // Should be unreachable in this loop
+  workers[0].run();
+
+  for (auto& thread : threads) thread.join();
+  close(serverFd);  // Should be unreachable, workers never return
 }
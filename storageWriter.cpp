@@ -0,0 +1,418 @@
+#include "storageWriter.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "defines.hpp"
+
+namespace {
+
+uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+uint64_t fileSize(int fd) {
+  struct stat st {};
+  return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+// Staging names carry the final path with '%' and '/' escaped.
+std::string escapePath(const std::string& path) {
+  std::string escaped;
+  for (char c : path) {
+    if (c == '%') {
+      escaped += "%25";
+    } else if (c == '/') {
+      escaped += "%2F";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string unescapePath(const std::string& escaped) {
+  std::string path;
+  for (size_t i = 0; i < escaped.size(); ++i) {
+    if (escaped.compare(i, 3, "%25") == 0) {
+      path += '%';
+      i += 2;
+    } else if (escaped.compare(i, 3, "%2F") == 0) {
+      path += '/';
+      i += 2;
+    } else {
+      path += escaped[i];
+    }
+  }
+  return path;
+}
+
+}  // namespace
+
+StorageWriter::StorageWriter(std::string stagingDir, size_t blockBytes,
+                             int fsyncSeconds)
+    : stagingDir_(std::move(stagingDir)),
+      blockBytes_(blockBytes),
+      fsyncSeconds_(fsyncSeconds) {}
+
+bool StorageWriter::prepare() {
+  if (stagingDir_.empty()) return true;
+  if (mkdir(stagingDir_.c_str(), 0700) != 0 && errno != EEXIST) {
+    perror(("[Storage] Cannot create staging directory " + stagingDir_)
+               .c_str());
+    stagingDir_.clear();
+    return false;
+  }
+  DIR* dir = opendir(stagingDir_.c_str());
+  if (!dir) {
+    perror(("[Storage] Cannot open staging directory " + stagingDir_)
+               .c_str());
+    stagingDir_.clear();
+    return false;
+  }
+  // Clips interrupted by a restart. What reached the card has no final
+  // header (unless synced periodically) and was never indexed, so retention
+  // would never remove it either.
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    unlink((stagingDir_ + "/" + entry->d_name).c_str());
+    // Only our own "<number>-<escaped path>" names lead to a final path.
+    const char* dash = std::strchr(entry->d_name, '-');
+    if (!dash || dash == entry->d_name ||
+        std::strspn(entry->d_name, "0123456789") !=
+            static_cast<size_t>(dash - entry->d_name)) {
+      continue;
+    }
+    std::string finalPath = unescapePath(dash + 1);
+    if (unlink(finalPath.c_str()) == 0) {
+      std::cout << "[Storage] Removed unfinished clip " << finalPath
+                << std::endl;
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+std::string StorageWriter::beginFile(const std::string& finalPath,
+                                     uint64_t expectedBytes) {
+  auto file = std::make_shared<File>();
+  file->final_path = finalPath;
+  file->expected_bytes = std::max<uint64_t>(expectedBytes, blockBytes_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stagingDir_.empty()) {
+    file->path = finalPath;
+  } else {
+    // Numbered, so the name is unique even if a path is reused
+    std::string name =
+        std::to_string(nextStagingId_++) + "-" + escapePath(finalPath);
+    file->staged = name.size() <= NAME_MAX;
+    file->path = file->staged ? stagingDir_ + "/" + name : finalPath;
+    if (!file->staged) {
+      std::cerr << "[Storage] Warning: Path too long to stage, writing "
+                << finalPath << " in place." << std::endl;
+    }
+  }
+  files_.push_back(file);
+  return file->path;
+}
+
+void StorageWriter::markWritten(const std::string& path) {
+  std::shared_ptr<File> file;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& candidate : files_) {
+      if (candidate->path == path && !candidate->finished) file = candidate;
+    }
+  }
+  struct stat st {};
+  if (!file || !file->staged || stat(path.c_str(), &st) != 0) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  file->stable_bytes =
+      std::max(file->stable_bytes, static_cast<uint64_t>(st.st_size));
+}
+
+void StorageWriter::finishFile(const std::string& path,
+                               std::function<void(bool ok, uint64_t size)>
+                                   done) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& file : files_) {
+    if (file->path == path && !file->finished && !file->discarded) {
+      file->finished = true;
+      file->done = std::move(done);
+      break;
+    }
+  }
+  wake_.notify_one();
+}
+
+void StorageWriter::discardFile(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& file : files_) {
+    if (file->path == path && !file->finished) file->discarded = true;
+  }
+  wake_.notify_one();
+}
+
+void StorageWriter::stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = true;
+  wake_.notify_one();
+}
+
+void StorageWriter::noteLatency(uint64_t nanos) {
+  uint64_t slowest = slowestWriteNanos_.load(std::memory_order_relaxed);
+  while (nanos > slowest && !slowestWriteNanos_.compare_exchange_weak(
+                                slowest, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+// Copies [from, to) of the staging file block by block. Writes start at
+// block boundaries and are a whole block long except at the end of a clip,
+// and each one is pushed to the card right away with sync_file_range(), so
+// dirty pages never pile up into one long flush.
+bool StorageWriter::copyRange(File& file, uint64_t from, uint64_t to) {
+  for (uint64_t offset = from; offset < to;) {
+    size_t length = static_cast<size_t>(
+        std::min<uint64_t>(blockBytes_ - offset % blockBytes_, to - offset));
+    ssize_t got = pread(file.staging_fd, buffer_.data(), length,
+                        static_cast<off_t>(offset));
+    if (got <= 0) {
+      perror(("[Storage] Failed to read " + file.path).c_str());
+      return false;
+    }
+    length = static_cast<size_t>(got);
+
+    while (offset + length > file.allocated) {
+      // Keeps the clip in few extents; ignored where unsupported.
+      fallocate(file.final_fd, FALLOC_FL_KEEP_SIZE,
+                static_cast<off_t>(file.allocated),
+                static_cast<off_t>(file.expected_bytes));
+      file.allocated += file.expected_bytes;
+    }
+
+    auto writeStart = std::chrono::steady_clock::now();
+    for (size_t written = 0; written < length;) {
+      ssize_t n = pwrite(file.final_fd, buffer_.data() + written,
+                         length - written,
+                         static_cast<off_t>(offset + written));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        perror(("[Storage] Failed to write " + file.final_path).c_str());
+        return false;
+      }
+      written += static_cast<size_t>(n);
+    }
+    sync_file_range(file.final_fd, static_cast<off_t>(offset),
+                    static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+    uint64_t writeNanos = nanosSince(writeStart);
+    noteLatency(writeNanos);
+    bytesWritten_.fetch_add(length, std::memory_order_relaxed);
+    file.unsynced = true;
+
+    // The first block is copied again once the header is final.
+    if (offset >= blockBytes_) {
+      fallocate(file.staging_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                static_cast<off_t>(offset), static_cast<off_t>(length));
+    }
+    offset += length;
+    file.copied = std::max(file.copied, offset);
+
+    if (maxBytesPerSecond_ > 0) {
+      uint64_t budgetNanos = length * 1000000000ULL / maxBytesPerSecond_;
+      if (budgetNanos > writeNanos) {
+        std::this_thread::sleep_for(
+            std::chrono::nanoseconds(budgetNanos - writeNanos));
+      }
+    }
+  }
+  return true;
+}
+
+// Copies whatever the clip's writer has staged since the last pass: whole
+// blocks below `stableBytes` while the clip is open, everything once it is
+// closed. Returns true when the file is complete on the card.
+bool StorageWriter::pump(File& file, bool finished, uint64_t stableBytes) {
+  if (!file.staged) {
+    if (!finished) return false;
+    file.final_fd = open(file.final_path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (file.final_fd < 0) {
+      perror(("[Storage] Cannot open " + file.final_path).c_str());
+    }
+    file.unsynced = file.final_fd >= 0;
+    complete(file, file.final_fd >= 0);
+    return true;
+  }
+
+  if (file.staging_fd < 0) {
+    file.staging_fd = open(file.path.c_str(), O_RDWR | O_CLOEXEC);
+    if (file.staging_fd < 0) {
+      if (!finished) return false;  // Not created by the writer yet
+      perror(("[Storage] Staged clip missing: " + file.path).c_str());
+      complete(file, false);
+      return true;
+    }
+  }
+  if (file.final_fd < 0 && !file.failed) {
+    file.final_fd = open(file.final_path.c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file.final_fd < 0) {
+      perror(("[Storage] Cannot create " + file.final_path).c_str());
+      file.failed = true;  // Not retried; the clip is lost
+    }
+  }
+  if (file.failed) {
+    if (!finished) return false;
+    complete(file, false);
+    return true;
+  }
+
+  file.staged_size = fileSize(file.staging_fd);
+  uint64_t end =
+      finished ? file.staged_size
+               : std::min(file.staged_size, stableBytes) / blockBytes_ *
+                     blockBytes_;
+  // The first block is written once, at the end, unless clips are synced
+  // while recording: then it goes early too, so a clip cut short by a crash
+  // still starts with a header.
+  bool firstBlockNow = fsyncSeconds_ > 0 && !finished;
+  uint64_t from =
+      std::max<uint64_t>(file.copied, firstBlockNow ? 0 : blockBytes_);
+  bool ok = end <= from || copyRange(file, from, end);
+  if (!finished) return false;
+  if (ok) {
+    ok = copyRange(file, 0, std::min<uint64_t>(blockBytes_, file.staged_size));
+  }
+  if (!ok) {
+    std::cerr << "[Storage] Error: " << file.final_path
+              << " is incomplete, removing it." << std::endl;
+  } else if (ftruncate(file.final_fd,
+                       static_cast<off_t>(file.staged_size)) != 0) {
+    // Only releases the preallocation past the end of the clip.
+    perror(("[Storage] Failed to trim " + file.final_path).c_str());
+  }
+  complete(file, ok);
+  return true;
+}
+
+// A clip that did not make it to the card whole is removed rather than left
+// for the recorder to index.
+void StorageWriter::complete(File& file, bool ok) {
+  if (!ok) {
+    if (file.final_fd >= 0) close(file.final_fd);
+    file.final_fd = -1;
+    file.unsynced = false;
+    unlink(file.final_path.c_str());
+  }
+  uint64_t size = file.final_fd >= 0 ? fileSize(file.final_fd) : 0;
+  if (fsyncSeconds_ == 0 && file.unsynced) sync(file);
+  if (file.staging_fd >= 0) {
+    close(file.staging_fd);
+    file.staging_fd = -1;
+  }
+  if (file.staged) unlink(file.path.c_str());
+  file.complete = true;
+  file.staged_size = file.copied;
+  if (file.done) file.done(ok, size);
+}
+
+void StorageWriter::sync(File& file) {
+  auto syncStart = std::chrono::steady_clock::now();
+  if (fsync(file.final_fd) != 0) {
+    perror(("[Storage] fsync failed for " + file.final_path).c_str());
+  }
+  noteLatency(nanosSince(syncStart));
+  fsyncs_.fetch_add(1, std::memory_order_relaxed);
+  file.unsynced = false;
+}
+
+void StorageWriter::closeFile(File& file) {
+  if (file.staging_fd >= 0) close(file.staging_fd);
+  if (file.final_fd >= 0) close(file.final_fd);
+  file.staging_fd = file.final_fd = -1;
+}
+
+void StorageWriter::run() {
+  std::cout << "[Storage] Starting storage writer loop ("
+            << (stagingDir_.empty() ? "writing in place"
+                                    : "staging in " + stagingDir_)
+            << ", " << (fsyncSeconds_ == 0
+                            ? std::string("fsync per clip")
+                            : "fsync every " + std::to_string(fsyncSeconds_) +
+                                  " s")
+            << ")." << std::endl;
+  buffer_.resize(blockBytes_);
+  auto nextSync = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(fsyncSeconds_);
+
+  while (true) {
+    std::vector<std::shared_ptr<File>> files;
+    std::vector<bool> finished;
+    std::vector<bool> discarded;
+    std::vector<uint64_t> stable;
+    bool stopping;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(STORAGE_POLL_MS));
+      }
+      stopping = stopping_;
+      files = files_;
+      for (const auto& file : files) {
+        finished.push_back(file->finished);
+        discarded.push_back(file->discarded);
+        stable.push_back(file->stable_bytes);
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool syncDue = fsyncSeconds_ > 0 && (now >= nextSync || stopping);
+    if (syncDue) nextSync = now + std::chrono::seconds(fsyncSeconds_);
+
+    std::vector<File*> retired;
+    uint64_t backlog = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+      File& file = *files[i];
+      if (discarded[i]) {
+        closeFile(file);
+        unlink(file.path.c_str());
+        if (file.staged) unlink(file.final_path.c_str());
+        retired.push_back(&file);
+        continue;
+      }
+      if (!file.complete) pump(file, finished[i], stable[i]);
+      if (syncDue && file.unsynced && file.final_fd >= 0) sync(file);
+      if (file.complete && !file.unsynced) {
+        closeFile(file);
+        retired.push_back(&file);
+      }
+      backlog += file.staged_size - std::min(file.copied, file.staged_size);
+    }
+    backlogBytes_.store(backlog, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.erase(std::remove_if(files_.begin(), files_.end(),
+                                [&](const std::shared_ptr<File>& file) {
+                                  return std::find(retired.begin(),
+                                                   retired.end(),
+                                                   file.get()) !=
+                                         retired.end();
+                                }),
+                 files_.end());
+    if (stopping && files_.empty()) break;
+  }
+  std::cout << "[Storage] Exiting storage writer loop." << std::endl;
+}
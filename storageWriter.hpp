@@ -0,0 +1,135 @@
+#ifndef STORAGE_WRITER
+#define STORAGE_WRITER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Gets recordings onto the SD card without the card's latency reaching the
+// pipeline and without wearing it with small writes. A clip's writer (the
+// muxer inside cv::VideoWriter) writes to a staging file in RAM, where its
+// many small writes and seeks cost nothing. This class's I/O thread (run())
+// copies the staged data to the final file in whole blocks of `blockBytes` at
+// block-aligned offsets, preallocating the final file with fallocate() as it
+// goes, and punches the copied blocks out of the staging file so a long clip
+// doesn't fill RAM. When the clip is finished the rest is copied, the file is
+// trimmed to size and synced according to the fsync policy, and only then is
+// the clip handed back for indexing.
+//
+// Muxers go back and patch what they wrote: OpenCV's AVI writer fills in each
+// frame's chunk size once the frame is written, and the header once the clip
+// is closed. So while a clip is open only blocks below the point the recorder
+// has declared final with markWritten() are copied (and punched), and the
+// first block is kept in staging and copied again at the end.
+//
+// A staging file is named after its final path, so prepare() can remove the
+// partial copies of clips a previous run never finished.
+//
+// One instance serves all cameras, since they share the card. Without a
+// staging directory clips are written in place and only synced here.
+class StorageWriter {
+ public:
+  StorageWriter(std::string stagingDir, size_t blockBytes, int fsyncSeconds);
+
+  // Must be called before run() starts. fsyncSeconds 0 syncs each clip once
+  // it is finished; N > 0 syncs whatever was written to any clip every N
+  // seconds instead. 0 bytes per second means no write rate limit.
+  void setStagingDir(std::string stagingDir) {
+    stagingDir_ = std::move(stagingDir);
+  }
+  void setFsyncSeconds(int seconds) { fsyncSeconds_ = seconds; }
+  void setWriteRateLimit(uint64_t bytesPerSecond) {
+    maxBytesPerSecond_ = bytesPerSecond;
+  }
+
+  // Creates the staging directory and removes files a previous run left in
+  // it, along with their partial copies on the card, which were never
+  // indexed. Falls back to writing in place (and returns false) if that
+  // fails.
+  bool prepare();
+
+  // I/O thread entry point. Returns after stop() once every file is done.
+  void run();
+  void stop();
+
+  // Recorder side; never blocks on the card. beginFile() returns the path
+  // the clip should be written to, which is `finalPath` itself when there is
+  // no staging directory. `expectedBytes` is preallocated up front and again
+  // whenever the clip outgrows it.
+  std::string beginFile(const std::string& finalPath, uint64_t expectedBytes);
+  // Called after each frame: the writer won't change anything now in `path`
+  // again, apart from the first block.
+  void markWritten(const std::string& path);
+  // Called once the writer has closed `path`. `done` runs on the I/O thread
+  // with the final size once the file is complete on the card. If it could
+  // not be, the partial file is removed and `done` gets false and 0.
+  void finishFile(const std::string& path,
+                  std::function<void(bool ok, uint64_t size)> done);
+  // Throws away a clip that was aborted, staged or not.
+  void discardFile(const std::string& path);
+
+  uint64_t bytesWritten() const {
+    return bytesWritten_.load(std::memory_order_relaxed);
+  }
+  uint64_t fsyncs() const { return fsyncs_.load(std::memory_order_relaxed); }
+  // Staged bytes not yet copied to the card
+  uint64_t backlogBytes() const {
+    return backlogBytes_.load(std::memory_order_relaxed);
+  }
+  // Slowest single block write or sync so far
+  double slowestWriteSeconds() const {
+    return slowestWriteNanos_.load(std::memory_order_relaxed) / 1e9;
+  }
+
+ private:
+  struct File {
+    std::string path;        // What the clip's writer writes to
+    std::string final_path;  // Where it ends up
+    uint64_t expected_bytes = 0;
+    bool staged = false;
+    uint64_t stable_bytes = 0;  // See markWritten(); guarded by mutex_
+    bool finished = false;  // Writer closed it; guarded by mutex_
+    bool discarded = false;  // Guarded by mutex_
+    std::function<void(bool, uint64_t)> done;
+    // I/O thread only
+    int staging_fd = -1;
+    int final_fd = -1;
+    uint64_t copied = 0;     // Staged bytes already on the card
+    uint64_t allocated = 0;  // Preallocated size of the final file
+    uint64_t staged_size = 0;
+    bool unsynced = false;   // Written to since the last sync
+    bool failed = false;     // The final file could not be created
+    bool complete = false;   // Waiting only for the periodic sync
+  };
+
+  bool pump(File& file, bool finished, uint64_t stableBytes);
+  bool copyRange(File& file, uint64_t from, uint64_t to);
+  void complete(File& file, bool ok);
+  void sync(File& file);
+  void closeFile(File& file);
+  void noteLatency(uint64_t nanos);
+
+  std::string stagingDir_;
+  const size_t blockBytes_;
+  int fsyncSeconds_;
+  uint64_t maxBytesPerSecond_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<std::shared_ptr<File>> files_;
+  uint64_t nextStagingId_ = 0;
+  bool stopping_ = false;
+
+  std::vector<char> buffer_;  // I/O thread only; one block
+  std::atomic<uint64_t> bytesWritten_{0};
+  std::atomic<uint64_t> fsyncs_{0};
+  std::atomic<uint64_t> backlogBytes_{0};
+  std::atomic<uint64_t> slowestWriteNanos_{0};
+};
+
+#endif /* STORAGE_WRITER */
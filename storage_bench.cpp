@@ -0,0 +1,331 @@
+// Recording storage latency benchmark. Writes clips the way OpenCV's AVI
+// muxer does (a chunk header, the frame in 4 KiB writes, a seek back to patch
+// the chunk's size, and a header patch at the end) at a camera's frame rate,
+// and measures how long each frame's writes hold up the writing thread, which
+// in motion_detect is the recorder. Each size is only patched when the next
+// frame comes, so an unpatched chunk header stays in the file for a frame
+// period, as behind a slow encoder or a buffering muxer.
+//
+// Usage: storage_bench [options]
+//   --dir=DIR              where clips go, i.e. the card (default
+//                          /tmp/storage_bench)
+//   --staging-dir=DIR      RAM staging directory (default
+//                          /dev/shm/storage_bench)
+//   --modes=M[,M...]       direct (write in place) and/or staged (through
+//                          StorageWriter); default both
+//   --seconds=N            recording time per mode (default 20)
+//   --clip-seconds=N       clip length (default 5)
+//   --fps=N                frame rate (default CAP_FPS)
+//   --frame-kb=N           frame size (default 60)
+//   --throttle-mbps=N      emulate a card that absorbs only N MB/s (0: none)
+//   --fsync=clip|N         StorageWriter fsync policy (default clip)
+//
+// The throttle charges every byte written to --dir to the thread that wrote
+// it: the recorder in direct mode, StorageWriter's I/O thread when staged.
+// For a real slow device, point --dir at one instead, e.g. an SD card or a
+// directory on a device limited with the cgroup v2 io.max controller.
+//
+// Output is one JSON object per mode with per-frame write latency (p50, p99,
+// max), frames whose writes took longer than a frame period, the peak staged
+// backlog and how long the card took to catch up after the last frame. Every
+// clip is then read back from --dir and checked chunk by chunk, patched sizes
+// included; corrupt_clips must be 0.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "storageWriter.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MUXER_WRITE_BYTES = 4096;
+const size_t CLIP_HEADER_BYTES = 64;
+const size_t CHUNK_HEADER_BYTES = 8;
+const uint32_t CHUNK_TAG = 0x63643030;  // "00dc"
+
+struct BenchOptions {
+  std::string dir = "/tmp/storage_bench";
+  std::string stagingDir = "/dev/shm/storage_bench";
+  double seconds = 20;
+  double clipSeconds = 5;
+  double fps = CAP_FPS;
+  size_t frameBytes = 60 * 1024;
+  uint64_t throttleBytesPerSecond = 0;
+  int fsyncSeconds = 0;
+};
+
+// Sleeps off the time an emulated card needs for `bytes`, if throttled.
+void throttle(const BenchOptions& options, size_t bytes,
+              Clock::time_point writeStart) {
+  if (options.throttleBytesPerSecond == 0) return;
+  auto budget = std::chrono::nanoseconds(
+      bytes * 1000000000ULL / options.throttleBytesPerSecond);
+  std::this_thread::sleep_until(writeStart + budget);
+}
+
+bool writeAll(int fd, const char* data, size_t size,
+              const BenchOptions& options, bool toCard) {
+  while (size > 0) {
+    auto start = Clock::now();
+    ssize_t n = write(fd, data, std::min(size, MUXER_WRITE_BYTES));
+    if (n <= 0) return false;
+    if (toCard) throttle(options, static_cast<size_t>(n), start);
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+  return values[rank];
+}
+
+// Checks a finished clip against what was written: the header, then per
+// frame the chunk tag, its patched size and the frame number in the payload.
+bool verifyClip(const std::string& path, long long frames,
+                const BenchOptions& options) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st {};
+  size_t chunkBytes = CHUNK_HEADER_BYTES + options.frameBytes;
+  bool ok = fstat(fd, &st) == 0 &&
+            static_cast<uint64_t>(st.st_size) ==
+                CLIP_HEADER_BYTES + frames * chunkBytes;
+  char header[CLIP_HEADER_BYTES];
+  ok = ok && pread(fd, header, sizeof(header), 0) ==
+                 static_cast<ssize_t>(sizeof(header)) &&
+       std::memcmp(header, "RIFF", 4) == 0;
+  for (long long n = 0; ok && n < frames; ++n) {
+    uint32_t chunk[4];  // Tag, size, then the frame number
+    ok = pread(fd, chunk, sizeof(chunk),
+               static_cast<off_t>(CLIP_HEADER_BYTES + n * chunkBytes)) ==
+             static_cast<ssize_t>(sizeof(chunk)) &&
+         chunk[0] == CHUNK_TAG && chunk[1] == options.frameBytes &&
+         chunk[2] == static_cast<uint32_t>(n);
+  }
+  close(fd);
+  return ok;
+}
+
+int runMode(const std::string& mode, const BenchOptions& options) {
+  bool staged = mode == "staged";
+  StorageWriter storage(staged ? options.stagingDir : "", STORAGE_BLOCK_BYTES,
+                        options.fsyncSeconds);
+  if (staged) {
+    if (!storage.prepare()) return 1;
+    storage.setWriteRateLimit(options.throttleBytesPerSecond);
+  }
+  std::thread ioThread(&StorageWriter::run, &storage);
+
+  std::vector<char> frame(options.frameBytes);
+  for (size_t i = 0; i < frame.size(); ++i) {
+    frame[i] = static_cast<char>((i * 2654435761u) >> 13);
+  }
+  const char header[CLIP_HEADER_BYTES] = "RIFF";
+
+  auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / options.fps));
+  long long totalFrames = std::llround(options.seconds * options.fps);
+  long long clipFrames =
+      std::max(1LL, std::llround(options.clipSeconds * options.fps));
+  std::vector<double> latencies;
+  latencies.reserve(static_cast<size_t>(totalFrames));
+  long long lateFrames = 0;
+  uint64_t peakBacklog = 0;
+  std::atomic<int> clipsPending{0};
+  int clips = 0, fd = -1;
+  std::string path;
+  std::vector<std::pair<std::string, long long>> written;  // Path, frames
+  off_t offset = 0, patchAt = -1;  // Where the last chunk's size goes
+  bool ok = true;
+
+  auto patchSize = [&] {
+    uint32_t size = static_cast<uint32_t>(frame.size());
+    auto patchStart = Clock::now();
+    bool patched = patchAt < 0 || pwrite(fd, &size, sizeof(size), patchAt) ==
+                                      static_cast<ssize_t>(sizeof(size));
+    if (!staged) throttle(options, sizeof(size), patchStart);
+    patchAt = -1;
+    return patched;
+  };
+  auto finishClip = [&] {
+    patchSize();
+    close(fd);
+    fd = -1;
+    clipsPending.fetch_add(1);
+    storage.finishFile(path,
+                       [&](bool, uint64_t) { clipsPending.fetch_sub(1); });
+  };
+
+  auto deadline = Clock::now();
+  for (long long n = 0; n < totalFrames && ok; ++n) {
+    std::this_thread::sleep_until(deadline);
+    auto start = Clock::now();
+
+    if (n % clipFrames == 0) {
+      std::string finalPath =
+          options.dir + "/clip" + std::to_string(clips++) + ".avi";
+      written.emplace_back(finalPath, 0);
+      path = storage.beginFile(
+          finalPath, static_cast<uint64_t>(options.frameBytes * clipFrames));
+      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        storage.discardFile(path);
+        ok = false;
+        break;
+      }
+      ok = writeAll(fd, header, sizeof(header), options, !staged);
+      offset = sizeof(header);
+    }
+    // Everything written so far is final once the last size is in.
+    if (patchAt >= 0) {
+      ok = ok && patchSize();
+      storage.markWritten(path);
+    }
+    uint32_t chunk[2] = {CHUNK_TAG, 0};
+    uint32_t frameNumber = static_cast<uint32_t>(written.back().second++);
+    std::memcpy(frame.data(), &frameNumber, sizeof(frameNumber));
+    ok = ok &&
+         writeAll(fd, reinterpret_cast<const char*>(chunk), sizeof(chunk),
+                  options, !staged) &&
+         writeAll(fd, frame.data(), frame.size(), options, !staged);
+    patchAt = offset + 4;
+    offset += sizeof(chunk) + frame.size();
+    if (ok && (n + 1) % clipFrames == 0) {
+      // The muxer rewrites its header with the final counts.
+      ok = patchSize() && pwrite(fd, header, sizeof(header), 0) ==
+           static_cast<ssize_t>(sizeof(header));
+      finishClip();
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start)
+                         .count();
+    latencies.push_back(seconds);
+    if (seconds > std::chrono::duration<double>(period).count()) {
+      lateFrames++;
+    }
+    peakBacklog = std::max(peakBacklog, storage.backlogBytes());
+    deadline = std::max(deadline + period, Clock::now());
+  }
+  if (!ok) perror(("[Bench] Error: Writing " + path + " failed").c_str());
+  if (fd >= 0) finishClip();
+
+  auto drainStart = Clock::now();
+  storage.stop();
+  ioThread.join();
+  double drainSeconds =
+      std::chrono::duration<double>(Clock::now() - drainStart).count();
+  int corruptClips = 0;
+  for (const auto& clip : written) {
+    if (!verifyClip(clip.first, clip.second, options)) {
+      std::cerr << "[Bench] Error: " << clip.first << " is corrupt."
+                << std::endl;
+      corruptClips++;
+    }
+  }
+
+  std::cout << "{\"mode\": \"" << mode << "\", \"clips\": " << clips
+            << ", \"frames\": " << latencies.size()
+            << ", \"frame_bytes\": " << options.frameBytes
+            << ", \"throttle_bytes_per_second\": "
+            << options.throttleBytesPerSecond
+            << ", \"write_ms_p50\": " << percentile(latencies, 50) * 1000
+            << ", \"write_ms_p99\": " << percentile(latencies, 99) * 1000
+            << ", \"write_ms_max\": " << percentile(latencies, 100) * 1000
+            << ", \"late_frames\": " << lateFrames
+            << ", \"peak_backlog_bytes\": " << peakBacklog
+            << ", \"card_bytes\": " << storage.bytesWritten()
+            << ", \"fsyncs\": " << storage.fsyncs()
+            << ", \"slowest_card_write_ms\": "
+            << storage.slowestWriteSeconds() * 1000
+            << ", \"drain_seconds\": " << drainSeconds
+            << ", \"corrupt_clips\": " << corruptClips << "}" << std::endl;
+  return ok && clipsPending.load() == 0 && corruptClips == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  std::vector<std::string> modes = {"direct", "staged"};
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--dir") {
+      options.dir = value;
+    } else if (name == "--staging-dir") {
+      options.stagingDir = value;
+    } else if (name == "--modes") {
+      modes.clear();
+      for (size_t start = 0; start <= value.size();) {
+        size_t comma = std::min(value.find(',', start), value.size());
+        modes.push_back(value.substr(start, comma - start));
+        start = comma + 1;
+      }
+    } else if (name == "--seconds") {
+      options.seconds = std::atof(value.c_str());
+    } else if (name == "--clip-seconds") {
+      options.clipSeconds = std::atof(value.c_str());
+    } else if (name == "--fps") {
+      options.fps = std::atof(value.c_str());
+    } else if (name == "--frame-kb") {
+      options.frameBytes = static_cast<size_t>(std::atof(value.c_str()) *
+                                               1024);
+    } else if (name == "--throttle-mbps") {
+      options.throttleBytesPerSecond =
+          static_cast<uint64_t>(std::atof(value.c_str()) * 1000000);
+    } else if (name == "--fsync") {
+      options.fsyncSeconds = value == "clip" ? 0 : std::atoi(value.c_str());
+    } else {
+      std::cerr << "Unknown option " << arg
+                << "; see the top of storage_bench.cpp for usage."
+                << std::endl;
+      return 1;
+    }
+  }
+  for (const std::string& mode : modes) {
+    if (mode != "direct" && mode != "staged") {
+      std::cerr << "[Bench] Error: Unknown mode " << mode << std::endl;
+      return 1;
+    }
+  }
+  if (options.seconds <= 0 || options.fps <= 0 || options.frameBytes == 0) {
+    std::cerr << "[Bench] Error: --seconds, --fps and --frame-kb must be "
+                 "positive." << std::endl;
+    return 1;
+  }
+  if (mkdir(options.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    perror(("[Bench] Error: Cannot create " + options.dir).c_str());
+    return 1;
+  }
+
+  int status = 0;
+  for (const std::string& mode : modes) {
+    status = std::max(status, runMode(mode, options));
+  }
+  return status;
+}
@@ -0,0 +1,102 @@
+#include "thumbnailCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+ThumbnailCache::ThumbnailCache(std::string dir, size_t capacityBytes)
+    : dir_(std::move(dir)), capacityBytes_(capacityBytes) {}
+
+std::string ThumbnailCache::nameFor(const std::string& clipName) {
+  return clipName.substr(0, clipName.find_last_of('.')) + ".jpg";
+}
+
+size_t ThumbnailCache::create(const std::string& clipName,
+                              const cv::Mat& frame, int width,
+                              int jpegQuality) {
+  if (frame.empty() || frame.cols <= 0) return 0;
+  int height = std::max(1, frame.rows * width / frame.cols);
+  cv::resize(frame, scaled_, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+  encodeParams_ = {cv::IMWRITE_JPEG_QUALITY, jpegQuality};
+  auto jpeg = std::make_shared<std::vector<uchar>>();
+  if (!cv::imencode(".jpg", scaled_, *jpeg, encodeParams_)) return 0;
+
+  std::string name = nameFor(clipName);
+  std::string path = dir_ + "/" + name;
+  FILE* file = std::fopen(path.c_str(), "wb");
+  bool written = file && std::fwrite(jpeg->data(), 1, jpeg->size(), file) ==
+                             jpeg->size();
+  if (file && std::fclose(file) != 0) written = false;
+  if (!written) {
+    perror(("[Thumbnails] Failed to write " + path).c_str());
+    std::remove(path.c_str());
+    return 0;
+  }
+  insert(name, jpeg);  // A new event is the one most likely to be looked at
+  return jpeg->size();
+}
+
+void ThumbnailCache::insert(const std::string& name, Jpeg jpeg) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(name);
+  if (it != entries_.end()) {
+    bytes_ -= it->second->jpeg->size();
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  if (jpeg->size() > capacityBytes_) return;
+  bytes_ += jpeg->size();
+  lru_.push_front({name, std::move(jpeg)});
+  entries_[name] = lru_.begin();
+  while (bytes_ > capacityBytes_) {
+    bytes_ -= lru_.back().jpeg->size();
+    entries_.erase(lru_.back().name);
+    lru_.pop_back();
+  }
+}
+
+ThumbnailCache::Jpeg ThumbnailCache::get(const std::string& name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return it->second->jpeg;
+    }
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+
+  std::string path = dir_ + "/" + name;
+  FILE* file = std::fopen(path.c_str(), "rb");
+  if (!file) return nullptr;
+  auto jpeg = std::make_shared<std::vector<uchar>>();
+  uchar buffer[16 * 1024];
+  size_t bytesRead;
+  while ((bytesRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    jpeg->insert(jpeg->end(), buffer, buffer + bytesRead);
+  }
+  bool failed = std::ferror(file);
+  std::fclose(file);
+  if (failed || jpeg->empty()) return nullptr;
+
+  insert(name, jpeg);
+  return jpeg;
+}
+
+void ThumbnailCache::remove(const std::string& clipName) {
+  std::string name = nameFor(clipName);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+      bytes_ -= it->second->jpeg->size();
+      lru_.erase(it->second);
+      entries_.erase(it);
+    }
+  }
+  std::string path = dir_ + "/" + name;
+  if (std::remove(path.c_str()) != 0 && errno != ENOENT) {
+    perror(("[Thumbnails] Failed to delete " + path).c_str());
+  }
+}
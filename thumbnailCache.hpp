@@ -0,0 +1,68 @@
+#ifndef THUMBNAIL_CACHE
+#define THUMBNAIL_CACHE
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Poster frames of recorded clips. Each clip's thumbnail is a small JPEG
+// stored next to it as <clip stem>.jpg; the most recently used ones are kept
+// in memory, bounded by total bytes, so browsing the detection list does not
+// hit the SD card for every image. Buffers are shared and immutable, so a
+// hit can be queued on a connection without copying.
+//
+// Thread-safe. Disk reads on a miss happen outside the lock.
+class ThumbnailCache {
+ public:
+  using Jpeg = std::shared_ptr<const std::vector<uchar>>;
+
+  ThumbnailCache(std::string dir, size_t capacityBytes);
+
+  // "motion_X.avi" -> "motion_X.jpg"
+  static std::string nameFor(const std::string& clipName);
+
+  // Downscales `frame` to `width` pixels wide, writes the thumbnail for
+  // `clipName` and caches it. Returns the file size, or 0 on failure.
+  size_t create(const std::string& clipName, const cv::Mat& frame, int width,
+                int jpegQuality);
+
+  // Thumbnail `name` (as returned by nameFor()) from memory or disk, or null
+  // if there is none.
+  Jpeg get(const std::string& name);
+
+  // Deletes the thumbnail of `clipName` from memory and disk.
+  void remove(const std::string& clipName);
+
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Entry {
+    std::string name;
+    Jpeg jpeg;
+  };
+
+  void insert(const std::string& name, Jpeg jpeg);
+
+  const std::string dir_;
+  const size_t capacityBytes_;
+
+  std::mutex mutex_;
+  std::list<Entry> lru_;  // Most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+  size_t bytes_ = 0;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+
+  // Writer thread only (create() is called by the recorder)
+  cv::Mat scaled_;
+  std::vector<int> encodeParams_;
+};
+
+#endif /* THUMBNAIL_CACHE */
@@ -0,0 +1,31 @@
+#include "tileGrid.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+TileGrid::TileGrid(int cols, int rows, const std::string& mask,
+                   int pixelsPerLevel, int defaultLevel, int minActiveTiles)
+    : cols_(std::max(1, cols)),
+      rows_(std::max(1, rows)),
+      minActiveTiles_(std::max(1, minActiveTiles)),
+      thresholds_(cols_ * rows_, defaultLevel * pixelsPerLevel) {
+  if (mask.empty()) return;
+  if (mask.size() != thresholds_.size()) {
+    std::cerr << "[TileGrid] Warning: mask has " << mask.size()
+              << " entries, expected " << thresholds_.size()
+              << ". Using the default level for every tile." << std::endl;
+    return;
+  }
+  for (size_t i = 0; i < mask.size(); ++i) {
+    char c = mask[i];
+    if (c == '.') {
+      thresholds_[i] = 0;
+    } else if (c >= '1' && c <= '9') {
+      thresholds_[i] = (c - '0') * pixelsPerLevel;
+    } else {
+      std::cerr << "[TileGrid] Warning: invalid mask character '" << c
+                << "' for tile " << i << ", using the default level."
+                << std::endl;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef TILE_GRID
+#define TILE_GRID
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Splits the analysed image into cols x rows tiles, each with its own
+// sensitivity, so a swaying tree or a TV in one corner can be ignored or made
+// less sensitive without affecting the rest of the scene.
+class TileGrid {
+ public:
+  // `mask` has one character per tile, row by row. '.' excludes the tile; a
+  // digit d (1-9) makes it active once d * pixelsPerLevel full-resolution
+  // pixels changed in it. An empty mask uses `defaultLevel` everywhere.
+  TileGrid(int cols, int rows, const std::string& mask, int pixelsPerLevel,
+           int defaultLevel, int minActiveTiles);
+
+  int cols() const { return cols_; }
+  int rows() const { return rows_; }
+  int size() const { return cols_ * rows_; }
+  bool included(int tile) const { return thresholds_[tile] > 0; }
+  int threshold(int tile) const { return thresholds_[tile]; }
+  int minActiveTiles() const { return minActiveTiles_; }
+
+ private:
+  int cols_;
+  int rows_;
+  int minActiveTiles_;
+  std::vector<int> thresholds_;  // Full-resolution pixels, 0 = excluded
+};
+
+// Where motion was seen in the most recently processed frame.
+struct TileActivity {
+  int cols = 0;
+  int rows = 0;
+  std::vector<int> changed;     // Changed pixels per tile (full-res units)
+  std::vector<uint8_t> active;  // 1 once the tile reached its threshold
+  int active_tiles = 0;
+  bool triggered = false;      // active_tiles >= TileGrid::minActiveTiles()
+  bool stopped_early = false;  // Comparison ended before the last row
+};
+
+#endif /* TILE_GRID */
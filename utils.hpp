@@ -2,29 +2,34 @@
 #define UTILS
 
 #include <atomic>
-#include <deque>
-#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <string>
 
-// --- Global Shared Resources ---
-struct MotionArtifact {
-  std::string video_filename;
-  std::string timestamp;
-  std::string pretty_timestamp;  // For display
-};
+#include "governor.hpp"
+#include "httpConnection.hpp"
+#include "metrics.hpp"
+#include "retentionManager.hpp"
+#include "storageWriter.hpp"
+
+struct Camera;
 
+// --- Global Shared Resources ---
 std::string sanitizeFilename(const std::string& filename);
 void startHttpServer();
-void handleHttpClient(int clientFd);
-void motionDetectionLoop();
+void handleHttpClient(HttpConnection& conn);
+void handleHttpClientClosed(HttpConnection& conn);
+bool feedDetectionEvents(HttpConnection& conn);
+void motionDetectionLoop(Camera& camera);
+void captureLoop(Camera& camera);
 
-extern std::deque<MotionArtifact> gRecentDetections;
-extern std::mutex gDetectionMutex;  // Protects g_recentDetections
-extern cv::VideoCapture gCap;
-extern std::mutex gCameraMutex;  // Protects g_cap
+// Per-camera pipelines (sources, frame buses, recorders, live hubs, indexes,
+// thumbnails and classifiers) live in gCameras, see camera.hpp.
+extern Metrics gMetrics;
+extern Governor gGovernor;
+extern RetentionManager gRetention;  // Deletes old clips from RECORDINGS_DIR
+extern StorageWriter gStorage;  // Moves finished video onto the card
 extern std::atomic<bool> gIsLiveStreamingActive;
 extern std::atomic<int>
-    gLiveStreamClientCount;  // Number of active live stream clients
+    gLiveStreamClientCount;  // Live stream clients across all cameras
 
 #endif /* UTILS */
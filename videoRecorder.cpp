@@ -0,0 +1,278 @@
+#include "videoRecorder.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "defines.hpp"
+#include "utils.hpp"
+
+VideoRecorder::VideoRecorder(size_t frameQueueCapacity,
+                             std::string recordingsDir, DetectionIndex& index,
+                             ThumbnailCache& thumbnails)
+    : frameQueueCapacity_(frameQueueCapacity),
+      recordingsDir_(std::move(recordingsDir)),
+      index_(index),
+      thumbnails_(thumbnails),
+      jobs_(frameQueueCapacity + 4) {}
+
+void VideoRecorder::enqueue(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (jobsCount_ == jobs_.size()) {
+      std::vector<Job> grown(jobs_.size() * 2);
+      for (size_t i = 0; i < jobsCount_; ++i) {
+        grown[i] = std::move(jobs_[(jobsHead_ + i) % jobs_.size()]);
+      }
+      jobs_.swap(grown);
+      jobsHead_ = 0;
+    }
+    jobs_[(jobsHead_ + jobsCount_) % jobs_.size()] = std::move(job);
+    jobsCount_++;
+  }
+  jobAvailable_.notify_one();
+}
+
+void VideoRecorder::beginClip(ClipInfo clip,
+                              std::vector<BufferedFrame> preRoll) {
+  Job job{Job::Kind::Begin};
+  job.clip = std::move(clip);
+  job.pre_roll = std::move(preRoll);
+  enqueue(std::move(job));
+}
+
+bool VideoRecorder::pushFrame(FramePtr frame, FrameMotion motion) {
+  if (queuedFrames_.load(std::memory_order_relaxed) >= frameQueueCapacity_) {
+    droppedFrames_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  queuedFrames_.fetch_add(1, std::memory_order_relaxed);
+  Job job{Job::Kind::Frame};
+  job.frame = std::move(frame);
+  job.motion = motion;
+  enqueue(std::move(job));
+  return true;
+}
+
+void VideoRecorder::resumeClip(std::vector<BufferedFrame> preRoll) {
+  Job job{Job::Kind::Resume};
+  job.pre_roll = std::move(preRoll);
+  enqueue(std::move(job));
+}
+
+void VideoRecorder::endClip(int motionScore, FramePtr peakFrame) {
+  Job job{Job::Kind::End};
+  job.clip.motion_score = motionScore;
+  job.frame = std::move(peakFrame);
+  enqueue(std::move(job));
+}
+
+void VideoRecorder::openClip(Job& job) {
+  if (writer_.isOpened()) finishClip(nullptr);  // Missing End
+
+  currentClip_ = std::move(job.clip);
+  framesWritten_ = 0;
+  clipDroppedAtStart_ = droppedFrames();
+  clipDuplicatedAtStart_ = duplicatedFrames();
+  clipSkippedAtStart_ = skippedFrames();
+
+  std::string videoFilename =
+      recordingsDir_ + "/" + currentClip_.video_filename;
+  // Written to a staging file; gStorage moves it onto the card. The first
+  // clip's size is a guess, later ones go by the previous clip.
+  double bytesPerFrame = bytesPerFrame_.load(std::memory_order_relaxed);
+  if (bytesPerFrame == 0) bytesPerFrame = currentClip_.frame_size.area() / 8.0;
+  double expectedBytes =
+      bytesPerFrame * currentClip_.fps * STORAGE_PREALLOCATE_SECONDS;
+  writerPath_ = gStorage.beginFile(videoFilename,
+                                   static_cast<uint64_t>(expectedBytes));
+  int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+  writer_.open(writerPath_, fourcc, currentClip_.fps, currentClip_.frame_size,
+               true);
+  if (!writer_.isOpened()) {
+    std::cerr << "[Recorder] Error: Could not open VideoWriter for "
+              << writerPath_ << std::endl;
+    gStorage.discardFile(writerPath_);
+    return;
+  }
+  recording_.store(true, std::memory_order_relaxed);
+
+  timeline_.open(recordingsDir_ + "/" +
+                 timelineNameFor(currentClip_.video_filename));
+  writeBuffered(job.pre_roll);
+  std::cout << "[Recorder] Recording " << videoFilename << " ("
+            << framesWritten_ << " pre-roll frames)." << std::endl;
+}
+
+void VideoRecorder::writeBuffered(const std::vector<BufferedFrame>& frames) {
+  for (const auto& frame : frames) {
+    // Padding first: it may repeat the previous pre-roll frame, which is
+    // still in decoded_ until the next decode.
+    if (!padTo(frame.capture_time)) continue;
+    cv::imdecode(frame.jpeg, cv::IMREAD_COLOR, &decoded_);
+    if (decoded_.empty()) continue;
+    lastFrame_.reset();
+    // The detector's result for pre-roll frames is not buffered.
+    writeFrame(decoded_, frame.capture_time, FrameMotion());
+  }
+}
+
+// Returns false if a frame captured at `captureTime` would run ahead of the
+// clip's frame rate. Otherwise repeats the last frame until the next slot is
+// the one this frame belongs in.
+bool VideoRecorder::padTo(std::chrono::steady_clock::time_point captureTime) {
+  if (framesWritten_ == 0) {
+    clipStart_ = captureTime;
+    return true;
+  }
+  double elapsed =
+      std::chrono::duration<double>(captureTime - clipStart_).count();
+  long long slot = std::llround(elapsed * currentClip_.fps);
+  if (slot < framesWritten_) {
+    skippedFrames_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  for (; framesWritten_ < slot; ++framesWritten_) {
+    writer_.write(lastImage_);
+    timeline_.append(
+        clipStart_ + std::chrono::duration_cast<
+                         std::chrono::steady_clock::duration>(
+                         std::chrono::duration<double>(framesWritten_ /
+                                                       currentClip_.fps)),
+        lastMotion_);
+    duplicatedFrames_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+// The timeline gets one sample per written frame, so sample n always
+// describes frame n of the clip.
+void VideoRecorder::writeFrame(
+    const cv::Mat& image, std::chrono::steady_clock::time_point captureTime,
+    const FrameMotion& motion) {
+  writer_.write(image);
+  gStorage.markWritten(writerPath_);  // Also covers padTo()'s repeats
+  timeline_.append(captureTime, motion);
+  framesWritten_++;
+  lastImage_ = image;
+  lastMotion_ = motion;
+}
+
+void VideoRecorder::finishClip(const FramePtr& peakFrame) {
+  if (!writer_.isOpened()) return;
+  writer_.release();
+  recording_.store(false, std::memory_order_relaxed);
+  uint64_t timelineBytes = timeline_.close();
+  lastImage_.release();
+  lastFrame_.reset();  // Back to the capture pool
+
+  std::string videoFilename =
+      recordingsDir_ + "/" + currentClip_.video_filename;
+  std::cout << "[Recorder] Finished recording " << videoFilename << ", "
+            << framesWritten_ << " frames, "
+            << droppedFrames() - clipDroppedAtStart_ << " dropped, "
+            << duplicatedFrames() - clipDuplicatedAtStart_ << " repeated, "
+            << skippedFrames() - clipSkippedAtStart_ << " skipped."
+            << std::endl;
+
+  if (framesWritten_ > 0) {  // Only add if some frames were written
+    DetectionRecord record;
+    // The first frame is the oldest pre-roll frame, captured before the
+    // trigger; the timeline's offsets count from it too.
+    auto firstFrameAge = std::chrono::steady_clock::now() - clipStart_;
+    record.start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          (std::chrono::system_clock::now() - firstFrameAge)
+                              .time_since_epoch())
+                          .count();
+    record.duration_ms =
+        static_cast<uint32_t>(framesWritten_ * 1000.0 / currentClip_.fps);
+    record.frame_count = static_cast<uint32_t>(framesWritten_);
+    record.motion_score = static_cast<uint32_t>(currentClip_.motion_score);
+    std::strncpy(record.filename, currentClip_.video_filename.c_str(),
+                 sizeof(record.filename) - 1);
+    // The frame is still in memory from detection, so the thumbnail costs a
+    // resize and a small encode rather than decoding the clip again.
+    size_t thumbnailBytes =
+        peakFrame ? thumbnails_.create(currentClip_.video_filename,
+                                       peakFrame->image, THUMBNAIL_WIDTH,
+                                       THUMBNAIL_JPEG_QUALITY)
+                  : 0;
+    if (thumbnailBytes > 0) {
+      record.flags |= DetectionRecord::HAS_THUMBNAIL;
+      record.size_bytes += thumbnailBytes;
+    }
+    if (timelineBytes > 0) {
+      record.flags |= DetectionRecord::HAS_TIMELINE;
+      record.size_bytes += timelineBytes;
+    }
+    // Listed once the clip is complete on the card, with its final size,
+    // which retention relies on. A clip that didn't get there is not listed
+    // at all, and its sidecars go with it.
+    gStorage.finishFile(
+        writerPath_,
+        [this, record, videoFilename, frames = framesWritten_](
+            bool ok, uint64_t videoBytes) mutable {
+          if (!ok) {
+            std::cerr << "[Recorder] Error: " << videoFilename
+                      << " could not be stored, dropping it." << std::endl;
+            thumbnails_.remove(record.name());
+            remove((recordingsDir_ + "/" + timelineNameFor(record.name()))
+                       .c_str());
+            return;
+          }
+          if (videoBytes > 0) {
+            bytesPerFrame_.store(static_cast<double>(videoBytes) / frames,
+                                 std::memory_order_relaxed);
+          }
+          record.size_bytes += videoBytes;
+          if (!index_.append(record)) {
+            std::cerr << "[Recorder] Error: Could not index " << videoFilename
+                      << std::endl;
+          }
+          gRetention.notify();
+        });
+  } else {  // Nothing reached the writer, don't leave an empty file behind
+    gStorage.discardFile(writerPath_);
+    remove((recordingsDir_ + "/" +
+            timelineNameFor(currentClip_.video_filename))
+               .c_str());
+    std::cout << "[Recorder] Recording aborted, deleted empty file: "
+              << videoFilename << std::endl;
+  }
+}
+
+void VideoRecorder::run() {
+  std::cout << "[Recorder] Starting recorder loop." << std::endl;
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex_);
+      jobAvailable_.wait(lock, [this] { return jobsCount_ > 0; });
+      job = std::move(jobs_[jobsHead_]);
+      jobsHead_ = (jobsHead_ + 1) % jobs_.size();
+      jobsCount_--;
+    }
+
+    switch (job.kind) {
+      case Job::Kind::Begin:
+        openClip(job);
+        break;
+      case Job::Kind::Frame:
+        queuedFrames_.fetch_sub(1, std::memory_order_relaxed);
+        if (writer_.isOpened() && padTo(job.frame->capture_time)) {
+          writeFrame(job.frame->image, job.frame->capture_time, job.motion);
+          lastFrame_ = std::move(job.frame);
+        }
+        break;
+      case Job::Kind::Resume:
+        if (writer_.isOpened()) writeBuffered(job.pre_roll);
+        break;
+      case Job::Kind::End:
+        currentClip_.motion_score = job.clip.motion_score;
+        finishClip(job.frame);
+        break;
+    }
+  }
+  std::cout << "[Recorder] Exiting recorder loop." << std::endl;
+}
@@ -0,0 +1,141 @@
+#ifndef VIDEO_RECORDER
+#define VIDEO_RECORDER
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "detectionIndex.hpp"
+#include "frameBus.hpp"
+#include "motionTimeline.hpp"
+#include "thumbnailCache.hpp"
+
+// Everything the writer needs to know about a clip before its first frame.
+struct ClipInfo {
+  std::string video_filename;  // Base name inside the recordings directory
+  std::chrono::system_clock::time_point start_time;
+  double fps = 0;
+  cv::Size frame_size;
+  int motion_score = 0;  // Filled in by endClip()
+};
+
+// A pre-roll frame handed to the writer, still JPEG-compressed.
+struct BufferedFrame {
+  std::vector<uchar> jpeg;
+  std::chrono::steady_clock::time_point capture_time;
+};
+
+// Recording stage that runs beside the detector. The detector describes clips
+// with beginClip()/pushFrame()/resumeClip()/endClip(), which only enqueue
+// work and never block; a dedicated writer thread (run()) does the encoding,
+// writes each clip's thumbnail and timeline sidecar (see TimelineWriter) and
+// hands the video to gStorage (see StorageWriter), which copies it to the card
+// and then appends the clip to the camera's index. When the writer falls
+// behind and the queue is full, frames are dropped and counted instead of
+// stalling capture.
+//
+// Frames are placed on the clip's time axis by their capture timestamps, not
+// by arrival: frame n of a clip is the one captured closest to n / fps after
+// its first frame. Gaps (dropped frames, a camera delivering below its
+// nominal rate) are filled by repeating the previous frame, and frames that
+// would run ahead of the rate are skipped, so a clip always plays back at
+// the speed it was recorded and its length matches the wall clock.
+class VideoRecorder {
+ public:
+  // Clips are written to `recordingsDir` and listed in `index`.
+  VideoRecorder(size_t frameQueueCapacity, std::string recordingsDir,
+                DetectionIndex& index, ThumbnailCache& thumbnails);
+
+  // Detector side. Clip boundaries are never dropped, only frames.
+  void beginClip(ClipInfo clip, std::vector<BufferedFrame> preRoll);
+  // `motion` goes into the clip's timeline next to the frame.
+  bool pushFrame(FramePtr frame, FrameMotion motion);
+  // Continues the open clip after a quiet gap with the history buffered
+  // meanwhile (see ClipPolicy), so the writer is not reopened.
+  void resumeClip(std::vector<BufferedFrame> preRoll);
+  // `motionScore` is the peak changed-pixel count seen during the clip and
+  // `peakFrame` the frame it was seen in, which becomes the thumbnail.
+  void endClip(int motionScore, FramePtr peakFrame);
+
+  // Writer thread entry point.
+  void run();
+
+  uint64_t droppedFrames() const {
+    return droppedFrames_.load(std::memory_order_relaxed);
+  }
+  size_t queueDepth() const {
+    return queuedFrames_.load(std::memory_order_relaxed);
+  }
+  // A clip is open on the writer side.
+  bool recording() const { return recording_.load(std::memory_order_relaxed); }
+  // Frames repeated to fill gaps, and frames left out for arriving ahead of
+  // the clip's frame rate.
+  uint64_t duplicatedFrames() const {
+    return duplicatedFrames_.load(std::memory_order_relaxed);
+  }
+  uint64_t skippedFrames() const {
+    return skippedFrames_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Job {
+    enum class Kind { Begin, Frame, Resume, End } kind;
+    ClipInfo clip;
+    std::vector<BufferedFrame> pre_roll;
+    FramePtr frame;
+    FrameMotion motion;
+  };
+
+  void enqueue(Job job);
+  void openClip(Job& job);
+  void writeBuffered(const std::vector<BufferedFrame>& frames);
+  bool padTo(std::chrono::steady_clock::time_point captureTime);
+  void writeFrame(const cv::Mat& image,
+                  std::chrono::steady_clock::time_point captureTime,
+                  const FrameMotion& motion);
+  void finishClip(const FramePtr& peakFrame);
+
+  const size_t frameQueueCapacity_;
+  const std::string recordingsDir_;
+  DetectionIndex& index_;
+  ThumbnailCache& thumbnails_;
+  std::mutex queueMutex_;
+  std::condition_variable jobAvailable_;
+  // Ring of pending jobs, allocated once; it only grows if control jobs
+  // arrive while it is full of frames.
+  std::vector<Job> jobs_;
+  size_t jobsHead_ = 0;
+  size_t jobsCount_ = 0;
+  std::atomic<size_t> queuedFrames_{0};
+  std::atomic<uint64_t> droppedFrames_{0};
+  std::atomic<bool> recording_{false};
+  std::atomic<uint64_t> duplicatedFrames_{0};
+  std::atomic<uint64_t> skippedFrames_{0};
+
+  // Video bytes per frame of the last clip, for preallocating the next
+  std::atomic<double> bytesPerFrame_{0};
+
+  // Writer thread state
+  cv::VideoWriter writer_;
+  std::string writerPath_;  // Where writer_ writes, usually a staging file
+  TimelineWriter timeline_;
+  ClipInfo currentClip_;
+  long long framesWritten_ = 0;
+  uint64_t clipDroppedAtStart_ = 0;
+  uint64_t clipDuplicatedAtStart_ = 0;
+  uint64_t clipSkippedAtStart_ = 0;
+  std::chrono::steady_clock::time_point clipStart_;  // Capture time, frame 0
+  cv::Mat decoded_;  // Pre-roll decode target, reused
+  // The last frame written, repeated over gaps. lastFrame_ keeps a live
+  // frame out of the capture pool while lastImage_ refers to its buffer.
+  cv::Mat lastImage_;
+  FramePtr lastFrame_;
+  FrameMotion lastMotion_;
+};
+
+#endif /* VIDEO_RECORDER */